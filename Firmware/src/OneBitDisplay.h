@@ -38,6 +38,8 @@ uint8_t mode; // data/command mode for 9-bit SPI
 uint8_t iDCPin, iMOSIPin, iCLKPin, iCSPin;
 uint8_t iLEDPin; // backlight
 uint8_t bBitBang;
+int iDirtyX1, iDirtyY1, iDirtyX2, iDirtyY2; // area touched since the last reset (LCD_VIRTUAL_EPD only)
+int iBandRow, iBandRows; // panel rows held in ucScreen (LCD_VIRTUAL_EPD only)
 } OBDISP;
 
 typedef char * (*SIMPLECALLBACK)(int iMenuItem);
@@ -124,7 +126,8 @@ enum {
   LCD_NOKIA5110,
   LCD_VIRTUAL,
   SHARP_144x168,
-  SHARP_400x240
+  SHARP_400x240,
+  LCD_VIRTUAL_EPD
 };
 
 // Rotation and flip angles to draw tiles
@@ -154,6 +157,26 @@ enum {
 // The memory buffer must be provided at the time of creation
 //
 void obdCreateVirtualDisplay(OBDISP *pOBD, int width, int height, uint8_t *buffer);
+//
+// Create a virtual display that stores its pixels in the EPD controller RAM layout
+// (one row of height/8 bytes per column starting at the right edge, MSB first, 1 = white)
+// so the buffer can be sent to the panel as is
+// Only obdFill, obdSetPixel, obdWriteStringCustom and obdRectangle support it
+//
+void obdCreateVirtualEPD(OBDISP *pOBD, int width, int height, uint8_t *buffer);
+//
+// Same, but the buffer only holds iRows panel rows (x columns counted from the right edge)
+// starting at iRow. Drawing outside the band is clipped, so a scene can be rendered
+// strip by strip with a small buffer. A band of 0 rows only tracks the dirty area
+//
+void obdCreateVirtualEPDBand(OBDISP *pOBD, int width, int height, uint8_t *buffer, int iRow, int iRows);
+//
+// Dirty area of a LCD_VIRTUAL_EPD display
+// Every drawing call grows the bounding box of the pixels it touched
+// obdGetDirtyRect() returns 0 if nothing was drawn since the last reset
+//
+void obdResetDirtyRect(OBDISP *pOBD);
+int obdGetDirtyRect(OBDISP *pOBD, int *x1, int *y1, int *x2, int *y2);
 // Constants for the obdCopy() function
 // Output format options -
 #define OBD_LSB_FIRST     0x001
@@ -35,6 +35,8 @@
 #define FILE_BUF_SIZE 2048
 #define MAX_IMAGE_WIDTH 2600
 #define FILE_HIGHWATER ((FILE_BUF_SIZE * 3) >> 2)
+// worst case compressed size of one line (~14 bits per pixel) plus look-ahead
+#define TIFF_PUSH_MARGIN(w) ((w) * 2 + 8)
 #define TIFF_TAG_SIZE 12
 #define MAX_TIFF_TAGS 128
 #define BITDIR_MSB_FIRST     1
@@ -56,7 +58,8 @@ enum {
 enum {
     TIFF_PIXEL_1BPP = 0,
     TIFF_PIXEL_2BPP,
-    TIFF_PIXEL_4BPP
+    TIFF_PIXEL_4BPP,
+    TIFF_PIXEL_SPANS // unscaled black runs straight from the decoder
 };
 
 typedef struct tiff_file_tag
@@ -86,6 +89,7 @@ typedef struct tiff_draw_tag
     int iScaledWidth; // width of the current line
     int iWidth, iHeight; // size of entire image in pixels
     uint8_t *pPixels; // 1 or 2-bit pixels
+    int16_t *pFlips; // TIFF_PIXEL_SPANS: start/end pairs of black runs, ends with iWidth
     uint8_t ucPixelType, ucLast;
 } TIFFDRAW;
 
@@ -105,6 +109,8 @@ typedef struct tiff_image_tag
     int iError;
     int y; // last y value drawn
     int iVLCOff, iVLCSize;
+    int iLine; // next line to decode
+    uint32_t ulBitOff; // bit position at iVLCOff
     int iStripSize, iStripOffset;
     int iPitch; // width in bytes of output buffer
     uint32_t u32Accum; // fractional scaling accumulator
@@ -150,6 +156,10 @@ class TIFFG4
 int TIFF_openTIFFFile(TIFFIMAGE *pImage, const char *szFilename, TIFF_OPEN_CALLBACK *pfnOpen, TIFF_CLOSE_CALLBACK *pfnClose, TIFF_READ_CALLBACK *pfnRead, TIFF_SEEK_CALLBACK *pfnSeek, TIFF_DRAW_CALLBACK *pfnDraw);
 #endif
     int TIFF_openRAW(TIFFIMAGE *pImage, int iWidth, int iHeight, int iFillOrder, uint8_t *pData, int iDataSize, TIFF_DRAW_CALLBACK *pfnDraw);
+    int TIFF_openPush(TIFFIMAGE *pImage, int iWidth, int iHeight, int iFillOrder, TIFF_DRAW_CALLBACK *pfnDraw);
+    int TIFF_pushData(TIFFIMAGE *pImage, const uint8_t *pData, int iLen);
+    int TIFF_pushEnd(TIFFIMAGE *pImage);
+    int TIFF_getLinesDecoded(TIFFIMAGE *pImage);
     void TIFF_close(TIFFIMAGE *pImage);
     void TIFF_setDrawParameters(TIFFIMAGE *pImage, uint32_t scale, int iPixelType, int iStartX, int iStartY, int iWidth, int iHeight, uint8_t *p4BPPBuf);
     int TIFF_decode(TIFFIMAGE *pImage);
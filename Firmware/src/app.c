@@ -5,6 +5,7 @@
 #include "drivers.h"
 #include "stack/ble/ble.h"
 #include "vendor/common/blt_common.h"
+#include "vendor/common/blt_soft_timer.h"
 
 #include "battery.h"
 #include "ble.h"
@@ -13,24 +14,104 @@
 #include "epd.h"
 #include "epd_spi.h"
 #include "etime.h"
+#include "schedule.h"
+#include "refresh_policy.h"
+#include "work_queue.h"
 #include "bart_tif.h"
 #include "uart.h"
 
 RAM uint8_t battery_level;
 RAM uint16_t battery_mv;
 RAM int16_t temperature;
+RAM uint8_t epd_busy_wakeup_armed = 0;
+
+// Wakeups (main_loop passes) counted in the current and in the last full hour
+RAM uint32_t app_wakeups;
+RAM uint32_t app_wakeups_last_hour;
+RAM uint8_t app_wakeups_hour = 0xff;
 
 // Settings
 extern settings_struct settings;
 
+_attribute_ram_code_ static void app_sample_sensors(void)
+{
+    battery_mv = get_battery_mv();
+    battery_level = get_battery_level(battery_mv);
+    temperature = EPD_read_temp(); //get_temperature_c();
+    set_adv_data(temperature * 10, battery_level, battery_mv);
+    ble_send_battery(battery_level);
+    ble_send_temp(temperature * 10);
+}
+
+_attribute_ram_code_ static void app_led_pulse(void)
+{
+    if (ble_get_connected())
+        set_led_color(3);
+    else
+        set_led_color(2);
+    WaitMs(1);
+    set_led_color(0);
+}
+
+_attribute_ram_code_ static void app_count_wakeup(void)
+{
+    struct date_time now = get_time();
+
+    if (now.tm_hour != app_wakeups_hour)
+    {
+        if (app_wakeups_hour != 0xff)
+            app_wakeups_last_hour = app_wakeups;
+        app_wakeups_hour = now.tm_hour;
+        app_wakeups = 0;
+    }
+    app_wakeups++;
+}
+
+void app_get_wakeups(uint32_t *last_hour, uint32_t *this_hour)
+{
+    *last_hour = app_wakeups_last_hour;
+    *this_hour = app_wakeups;
+}
+
+#if APP_EVENT_TIMERS
+// blt_soft_timer callbacks, the return value is the next interval in us
+// The minute tick only needs to wake us up, main_loop then advances the clock and redraws
+_attribute_ram_code_ static int app_minute_tick(void)
+{
+    return time_us_to_next_minute() + 1000;
+}
+
+_attribute_ram_code_ static int app_sensor_tick(void)
+{
+    app_sample_sensors();
+    return 30 * 1000 * 1000;
+}
+
+_attribute_ram_code_ static int app_led_tick(void)
+{
+    app_led_pulse();
+    return 10 * 1000 * 1000;
+}
+#endif
+
 _attribute_ram_code_ void user_init_normal(void)
 {                            // this will get executed one time after power up
     random_generator_init(); // must
+    init_flash(); // before init_time(), which loads the learned 32k rate
     init_time();
+    refresh_policy_init();
     init_ble();
-    init_flash();
+    schedule_init();
     init_nfc();
 
+#if APP_EVENT_TIMERS
+    // First run right away, then each callback returns its own period
+    blt_soft_timer_init();
+    blt_soft_timer_add(app_minute_tick, time_us_to_next_minute() + 1000);
+    blt_soft_timer_add(app_sensor_tick, 1000);
+    blt_soft_timer_add(app_led_tick, 1000);
+#endif
+
     // epd_display_tiff((uint8_t *)bart_tif, sizeof(bart_tif));
     // epd_display(3334533);
 }
@@ -45,40 +126,42 @@ _attribute_ram_code_ void user_init_deepRetn(void)
 _attribute_ram_code_ void main_loop(void)
 {
     blt_sdk_main_loop();
+    work_queue_run(); // EPD work requested by the BLE callbacks in this pass
+    app_count_wakeup();
     handler_time();
 
+#if APP_EVENT_TIMERS
+    blt_soft_timer_process(MAINLOOP_ENTRY);
+#else
     if (time_reached_period(Timer_CH_1, 30))
-    {
-        battery_mv = get_battery_mv();
-        battery_level = get_battery_level(battery_mv);
-        temperature = EPD_read_temp(); //get_temperature_c();
-        set_adv_data(temperature * 10, battery_level, battery_mv);
-        ble_send_battery(battery_level);
-        ble_send_temp(temperature * 10);
-    }
-
-    epd_update(get_time(), battery_mv, temperature);
+        app_sample_sensors();
 
     if (time_reached_period(Timer_CH_0, 10))
-    {
-        if (ble_get_connected())
-            set_led_color(3);
-        else
-            set_led_color(2);
-        WaitMs(1);
-        set_led_color(0);
-    }
+        app_led_pulse();
+#endif
+
+    // Scene changes and uploads requested over BLE are drawn on the wakeup that delivered them
+    epd_update(get_time(), battery_mv, temperature);
 
-    
-    if (epd_state_handler()) // if epd_update is ongoing enable gpio wakeup to put the display to sleep as fast as possible
+    // While an EPD update is ongoing suspend (GPIO state is kept, unlike deep retention)
+    // and let the BUSY pin wake us as soon as the controller is ready for the next step.
+    // An update held for a direct upload has nothing to wait for, BLE wakes us.
+    if (epd_state_handler() && !epd_direct_ready())
     {
-        cpu_set_gpio_wakeup(EPD_BUSY, 1, 1);
+        cpu_set_gpio_wakeup(EPD_BUSY, epd_busy_wakeup_level(), 1);
         bls_pm_setWakeupSource(PM_WAKEUP_PAD);
-        bls_pm_setSuspendMask(SUSPEND_DISABLE);
+        bls_pm_setSuspendMask(SUSPEND_ADV | SUSPEND_CONN);
+        epd_busy_wakeup_armed = 1;
     }
     else
     {
+        if (epd_busy_wakeup_armed)
+        { // the powered off panel must not keep waking us up
+            cpu_set_gpio_wakeup(EPD_BUSY, epd_busy_wakeup_level(), 0);
+            bls_pm_setWakeupSource(0);
+            epd_busy_wakeup_armed = 0;
+        }
         blt_pm_proc();
     }
-    
+
 }
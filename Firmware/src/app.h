@@ -11,4 +11,5 @@
 
 void user_init_normal(void);
 void user_init_deepRetn(void);
-void main_loop(void);
\ No newline at end of file
+void main_loop(void);
+void app_get_wakeups(uint32_t *last_hour, uint32_t *this_hour);
\ No newline at end of file
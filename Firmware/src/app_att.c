@@ -3,6 +3,7 @@
 #include "main.h"
 #include "stack/ble/ble.h"
 #include "epd_ble_service.h"
+#include "epd_timing.h"
 #include "ble.h"
 
 typedef struct
@@ -92,6 +93,10 @@ static const  u8 my_EPD_BLEUUID[16]				= { EPD_BLE_CHAR_UUID };
 static const  u8 my_EPD_BLE_ServiceUUID[16]		= { EPD_BLE_SERVICE_UUID };
 static u8 	  my_EPD_BLE_Data 					= 0x00;
 static u8  my_EPD_BLEInCCC[2];
+// EPD refresh timing statistics, struct epd_timing, any write resets them
+// 4B646063-6264-F3A7-8941-E65356EA82FF
+#define EPD_TIMING_CHAR_UUID 0xff, 0x82, 0xea, 0x56, 0x53, 0xe6, 0x41, 0x89, 0xa7, 0xf3, 0x64, 0x62, 0x63, 0x60, 0x64, 0x4b
+static const  u8 my_EPD_TimingUUID[16]			= { EPD_TIMING_CHAR_UUID };
 
 // Include attribute (Battery service)
 static const u16 include[3] = {BATT_PS_H, BATT_LEVEL_INPUT_CCB_H, SERVICE_UUID_BATTERY};
@@ -151,11 +156,17 @@ static const u8 my_RxTxCharVal[5] = {
 
 //// EPD_BLE attribute values
 static const u8 my_EPD_BLECharVal[19] = {
-	CHAR_PROP_NOTIFY | CHAR_PROP_WRITE,
+	CHAR_PROP_NOTIFY | CHAR_PROP_WRITE | CHAR_PROP_WRITE_WITHOUT_RSP,
 	U16_LO(EPD_BLE_CMD_OUT_DP_H), U16_HI(EPD_BLE_CMD_OUT_DP_H),
 	EPD_BLE_CHAR_UUID,
 };
 
+static const u8 my_EPD_TimingCharVal[19] = {
+	CHAR_PROP_READ | CHAR_PROP_WRITE,
+	U16_LO(EPD_TIMING_DP_H), U16_HI(EPD_TIMING_DP_H),
+	EPD_TIMING_CHAR_UUID,
+};
+
 // TM : to modify
 static const attribute_t my_Attributes[] = {
 	{ATT_END_H - 1, 0,0,0,0,0},	// total num of attribute
@@ -197,10 +208,12 @@ static const attribute_t my_Attributes[] = {
 	{0,ATT_PERMISSIONS_WRITE, 2,sizeof(my_RxTx_Data),(u8*)(&my_RxTxUUID),	(&my_RxTx_Data), &RxTxWrite},			//value
 	{0,ATT_PERMISSIONS_RDWR,2,sizeof(RxTxValueInCCC),(u8*)(&clientCharacterCfgUUID), 	(u8*)(RxTxValueInCCC), 0},	//value
 	////////////////////////////////////// EPD_BLE ////////////////////////////////////////////////////
-	{4,ATT_PERMISSIONS_READ, 2, 16,(u8*)(&my_primaryServiceUUID), (u8*)(&my_EPD_BLE_ServiceUUID), 0},
+	{6,ATT_PERMISSIONS_READ, 2, 16,(u8*)(&my_primaryServiceUUID), (u8*)(&my_EPD_BLE_ServiceUUID), 0},
 	{0,ATT_PERMISSIONS_READ, 2, sizeof(my_EPD_BLECharVal), (u8*)(&my_characterUUID), (u8*)(my_EPD_BLECharVal), 0},
 	{0,ATT_PERMISSIONS_WRITE, 16, sizeof(my_EPD_BLE_Data), (u8*)(&my_EPD_BLEUUID),	(&my_EPD_BLE_Data), (att_readwrite_callback_t) &epd_ble_handle_write},
 	{0,ATT_PERMISSIONS_RDWR, 2, sizeof(my_EPD_BLEInCCC),(u8*)(&clientCharacterCfgUUID), 	(u8*)(my_EPD_BLEInCCC), 0},	//value
+	{0,ATT_PERMISSIONS_READ, 2, sizeof(my_EPD_TimingCharVal), (u8*)(&my_characterUUID), (u8*)(my_EPD_TimingCharVal), 0},
+	{0,ATT_PERMISSIONS_RDWR, 16, sizeof(epd_timing), (u8*)(&my_EPD_TimingUUID), (u8*)(&epd_timing), (att_readwrite_callback_t) &epd_timing_write},
 };
 
 void my_att_init(void)
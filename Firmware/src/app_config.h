@@ -8,6 +8,10 @@ extern "C" {
 
 #define ADVERTISING_INTERVAL 1600
 
+// Periodic app work: 1 = blt_soft_timer deadlines, the PM layer wakes up for the
+// earliest one, 0 = polled on every wakeup of the BLE stack
+#define APP_EVENT_TIMERS 1
+
 #define RAM _attribute_data_retention_ // short version, this is needed to keep the values in ram after sleep
 
 #include "application/print/u_printf.h"
@@ -73,6 +77,8 @@ typedef enum
 	EPD_BLE_CMD_OUT_CD_H,						//UUID: , 	VALUE:  			Prop: write_without_rsp
 	EPD_BLE_CMD_OUT_DP_H,						//UUID: EPD_BLE uuid,  VALUE: EPD_BLEData
 	EPD_BLE_CMD_OUT_DESC_H,						//UUID: , 	VALUE: EPD_BLEName
+	EPD_TIMING_CD_H,							//UUID: 2803, 	VALUE:  			Prop: read | write
+	EPD_TIMING_DP_H,							//UUID: EPD timing uuid,  VALUE: epd_timing
 
 	ATT_END_H,
 
@@ -12,6 +12,9 @@
 #include "ble.h"
 #include "cmd_parser.h"
 #include "flash.h"
+#include "epd_ble_service.h"
+#include "epd_slot.h"
+#include "work_queue.h"
 
 RAM uint8_t ble_connected = 0;
 RAM uint8_t ota_started = 0;
@@ -59,6 +62,7 @@ _attribute_ram_code_ void ble_disconnect_callback(uint8_t e, uint8_t *p, int n)
 {
 	ble_connected = 0;
 	ota_started = 0;
+	epd_ble_upload_reset();
 	printf("BLE disconnected\r\n");
 }
 
@@ -98,7 +102,13 @@ _attribute_ram_code_ int RxTxWrite(void *p)
 
 _attribute_ram_code_ void blt_pm_proc(void)
 {
-	bls_pm_setSuspendMask(SUSPEND_ADV | DEEPSLEEP_RETENTION_ADV | SUSPEND_CONN | DEEPSLEEP_RETENTION_CONN);
+	if (epd_ble_upload_active() || work_queue_pending()) // keep the uploaded image planes
+		bls_pm_setSuspendMask(SUSPEND_ADV | SUSPEND_CONN);
+	else
+	{
+		epd_base_keep(); // deep retention clears the planes a delta upload patches
+		bls_pm_setSuspendMask(SUSPEND_ADV | DEEPSLEEP_RETENTION_ADV | SUSPEND_CONN | DEEPSLEEP_RETENTION_CONN);
+	}
 }
 
 void init_ble(void)
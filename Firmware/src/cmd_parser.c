@@ -7,9 +7,43 @@
 
 #include "etime.h"
 #include "flash.h"
+#include "epd_spi.h"
+#include "schedule.h"
+#include "refresh_policy.h"
+#include "app.h"
+#include "work_queue.h"
 
 extern settings_struct settings;
 extern uint8_t epd_temperature; // last measured EPD temperature (°C)
+extern uint8_t epd_update_state;
+
+// Panel updates run from main_loop, see work_queue.c
+_attribute_ram_code_ static uint8_t cmd_work_display_char(const uint8_t *arg)
+{
+	if (epd_update_state)
+		return 0;
+	epd_display_char(arg[0]);
+	return 1;
+}
+
+_attribute_ram_code_ static uint8_t cmd_work_display_slot(const uint8_t *arg)
+{
+	if (epd_update_state)
+		return 0;
+	u8 buf[2] = {0xE4, epd_display_slot(arg[0], 1)};
+	bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+	return 1;
+}
+
+// Reply ff ff <cmd> when the work queue is full, to be retried
+_attribute_ram_code_ static void cmd_work_push(work_fn fn, uint8_t cmd, const uint8_t *arg)
+{
+	if (!work_queue_push(fn, arg, 1))
+	{
+		u8 buf[3] = {0xff, 0xff, cmd};
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+	}
+}
 
 #define testPin GPIO_PD3
 void cmd_parser(void *p)
@@ -40,7 +74,7 @@ void cmd_parser(void *p)
 	}
 	else if (inData == 0xB1)
 	{
-		epd_display_char(req->dat[1]);
+		cmd_work_push(cmd_work_display_char, inData, &req->dat[1]);
 	}
 	else if (inData == 0xB0)
 	{
@@ -85,9 +119,9 @@ void cmd_parser(void *p)
 			settings.temp_alarm_point = 1;
 	}
 	else if (inData == 0xDD)
-	{ // Set time
+	{ // Set time, the date bytes after it are no longer needed, the date is derived from the time
 		uint32_t new_time = (req->dat[1] << 24) + (req->dat[2] << 16) + (req->dat[3] << 8) + (req->dat[4] & 0xff);
-		set_time(new_time, (req->dat[5] << 8) + req->dat[6], req->dat[7], req->dat[8], req->dat[9]);
+		set_time(new_time);
 	}
 	else if (inData == 0xDE)
 	{ // Save settings in flash to default
@@ -121,4 +155,69 @@ void cmd_parser(void *p)
 			set_EPD_wait_flush();
 		}
 	}
+	else if (inData == 0xE3)
+	{ // EPD bus statistics: bytes sent and upload busy time in us, both uint32 little-endian
+		uint32_t bytes_sent, busy_us;
+		EPD_SPI_get_stats(&bytes_sent, &busy_us);
+		u8 buf[9] = {0xE3,
+					 (u8)bytes_sent, (u8)(bytes_sent >> 8), (u8)(bytes_sent >> 16), (u8)(bytes_sent >> 24),
+					 (u8)busy_us, (u8)(busy_us >> 8), (u8)(busy_us >> 16), (u8)(busy_us >> 24)};
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+		if (req->dat[1] == 0x01)
+			EPD_SPI_reset_stats();
+	}
+	else if (inData == 0xE4)
+	{ // show the image stored in flash slot dat[1] once the panel is idle, replies 0xE4 and 1 if it was shown
+		cmd_work_push(cmd_work_display_slot, inData, &req->dat[1]);
+	}
+	else if (inData == 0xE5)
+	{ // set schedule entry dat[1]: weekday mask (bit 7 full refresh), hour, minute, action (scene or 0x80 | slot)
+		u8 buf[2] = {0xE5, schedule_set(req->dat[1], &req->dat[2])};
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+	}
+	else if (inData == 0xE6)
+	{ // save the schedule in flash
+		schedule_save();
+	}
+	else if (inData == 0xE7)
+	{ // read schedule entry dat[1]
+		u8 buf[6] = {0xE7, req->dat[1]};
+		if (schedule_get(req->dat[1], &buf[2]))
+			bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+	}
+	else if (inData == 0xE8)
+	{ // wakeups in the last full hour and so far in this hour, both uint32 little-endian
+		uint32_t last_hour, this_hour;
+		app_get_wakeups(&last_hour, &this_hour);
+		u8 buf[9] = {0xE8,
+					 (u8)last_hour, (u8)(last_hour >> 8), (u8)(last_hour >> 16), (u8)(last_hour >> 24),
+					 (u8)this_hour, (u8)(this_hour >> 8), (u8)(this_hour >> 16), (u8)(this_hour >> 24)};
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+	}
+	else if (inData == 0xE9)
+	{ // set the time zone: minutes added to the time set with 0xDD, int16 big-endian
+		set_time_zone((int16_t)((req->dat[1] << 8) | req->dat[2]));
+	}
+	else if (inData == 0xEA)
+	{ // EPD refreshes done and skipped as unchanged, both uint32 little-endian, dat[1] == 1 resets them
+		uint32_t done, skipped;
+		epd_get_refresh_stats(&done, &skipped);
+		u8 buf[9] = {0xEA,
+					 (u8)done, (u8)(done >> 8), (u8)(done >> 16), (u8)(done >> 24),
+					 (u8)skipped, (u8)(skipped >> 8), (u8)(skipped >> 16), (u8)(skipped >> 24)};
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+		if (req->dat[1] == 0x01)
+			epd_reset_refresh_stats();
+	}
+	else if (inData == 0xEB)
+	{ // set the EPD refresh policy thresholds: max partials, max fast, change %, cold °C, fast min °C
+		refresh_policy_set(&req->dat[1]);
+	}
+	else if (inData == 0xEC)
+	{ // read the refresh policy thresholds, then the most partial refreshes of a region since its last cleaning
+		u8 buf[1 + sizeof(struct refresh_policy_cfg) + 1] = {0xEC};
+		refresh_policy_get(&buf[1]);
+		buf[sizeof(buf) - 1] = refresh_policy_wear();
+		bls_att_pushNotifyData(RxTx_CMD_OUT_DP_H, buf, sizeof(buf));
+	}
 }
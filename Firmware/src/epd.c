@@ -16,7 +16,9 @@
 
 #include "OneBitDisplay.h"
 #include "TIFF_G4.h"
-extern const uint8_t ucMirror[];
+#include "epd_slot.h"
+#include "refresh_policy.h"
+#include "epd_timing.h"
 #include "font_60.h"
 #include "font16.h"
 #include "font16zh.h"
@@ -24,25 +26,84 @@ extern const uint8_t ucMirror[];
 
 #define LOG_UART(charP) puts(charP)
 
+extern uint32_t epd_spi_busy_ticks;
+
 RAM uint8_t epd_model = 2; // 0 = Undetected, 1 = BW213, 2 = BWR213_PRO, 3 = BWR154, 4 = BW213ICE, 5 BWR296
 const char *epd_model_string[] = {"NC", "BW213", "BWR213", "BWR154", "213ICE", "BWR296"};
 RAM uint8_t epd_update_state = 0;
+RAM struct epd_job epd_job;
+RAM uint32_t epd_wait_start;
+RAM uint32_t epd_wait_ticks;
 
 RAM uint8_t epd_scene = 2;
 RAM uint8_t epd_wait_update = 0;
+RAM uint8_t epd_pending_slot = 0xff; // image slot to show once the panel is idle
+RAM uint8_t epd_pending_slot_full;
+RAM uint8_t epd_scene_drawn = 0; // scene shown on the panel, 0 = none or an uploaded image
+
+// Hash per plane of the frame on the panel, valid once an update ran to the end.
+// Updates that would show the same frame again are skipped.
+RAM uint32_t epd_shown_hash[2];
+RAM uint8_t epd_shown_hash_valid = 0;
+RAM uint32_t epd_refresh_done = 0;
+RAM uint32_t epd_refresh_skipped = 0;
 
-RAM uint8_t hour_refresh = 100;
 RAM uint8_t minute_refresh = 100;
 
 const char *BLE_conn_string[] = {"BLE 0", "BLE 1"};
 RAM uint8_t epd_temperature_is_read = 0;
 RAM uint8_t epd_temperature = 0;
 
-RAM uint8_t epd_buffer[epd_buffer_size];
+// Image planes for BLE uploads and TIFF decoding, in the panel RAM layout. Scenes
+// don't use them, so they stay out of retention RAM, see epd_ble_upload_active()
+uint8_t epd_buffer[epd_buffer_size];
 uint8_t epd_buffer_red[epd_buffer_size];
-RAM uint8_t epd_temp[epd_buffer_size]; // for OneBitDisplay to draw into
-OBDISP obd;                            // virtual display structure
+OBDISP obd; // virtual display structure
 TIFFIMAGE tiff;
+uint8_t epd_tiff_stride; // bytes per panel RAM column of the image being decoded
+uint8_t epd_buffer_shown = 0; // the planes hold the image on the panel, cleared on wake from deep retention, see epd_base_load()
+
+// Scenes keep their text here, their draw functions run again for every band
+#define EPD_TEXT_COUNT 6
+#define EPD_TEXT_LEN 24
+RAM char epd_scene_text[EPD_TEXT_COUNT][EPD_TEXT_LEN];
+
+// Lines of the default scene
+enum
+{
+    EPD_LINE_NAME,
+    EPD_LINE_BLE,
+    EPD_LINE_TEMPERATURE,
+    EPD_LINE_BATTERY,
+    EPD_LINE_TIME
+};
+
+// Text of the time with date scene. The first EPD_FIELD_COUNT change between
+// frames, what the panel shows of them is kept to find the area to update.
+struct epd_text_field
+{
+    const GFXfont *font;
+    int16_t x, y;
+    uint8_t color;
+};
+enum
+{
+    EPD_FIELD_TIME,
+    EPD_FIELD_TEMPERATURE,
+    EPD_FIELD_VOLTAGE,
+    EPD_FIELD_DATE,
+    EPD_FIELD_LEVEL,
+    EPD_FIELD_COUNT,
+    EPD_FIELD_NAME = EPD_FIELD_COUNT
+};
+const struct epd_text_field epd_date_fields[EPD_FIELD_COUNT] = {
+    {&DSEG14_Classic_Mini_Regular_40, 35, 85, 1}, // Time (HH:MM) big segmented font
+    {&Dialog_plain_16, 216, 50, 1},               // Temperature
+    {&Dialog_plain_16, 216, 84, 1},               // Battery voltage in mV
+    {&Dialog_plain_16, 10, 120, 1},               // Date (YYYY-MM-DD)
+    {&Dialog_plain_16, 219, 18, 0},               // Battery percentage, white on the battery icon
+};
+RAM char epd_drawn_text[EPD_FIELD_COUNT][EPD_TEXT_LEN];
 
 // With this we can force a display if it wasnt detected correctly
 void set_EPD_model(uint8_t model_nr)
@@ -53,10 +114,22 @@ void set_EPD_model(uint8_t model_nr)
 // With this we can force a display if it wasnt detected correctly
 void set_EPD_scene(uint8_t scene)
 {
+    epd_pending_slot = 0xff;
     epd_scene = scene;
     set_EPD_wait_flush();
 }
 
+// Switch the scene, without full_refresh it is drawn with a partial update on the next loop
+void set_EPD_scene_refresh(uint8_t scene, uint8_t full_refresh)
+{
+    epd_pending_slot = 0xff;
+    epd_scene = scene;
+    if (full_refresh)
+        set_EPD_wait_flush();
+    else
+        minute_refresh = 100;
+}
+
 void set_EPD_wait_flush()
 {
     epd_wait_update = 1;
@@ -113,7 +186,8 @@ _attribute_ram_code_ void EPD_detect_model(void)
 
 _attribute_ram_code_ uint8_t EPD_read_temp(void)
 {
-    if (epd_temperature_is_read)
+    // While an update is running the panel belongs to the display job
+    if (epd_temperature_is_read || epd_update_state)
         return epd_temperature;
 
     if (!epd_model)
@@ -146,10 +220,76 @@ _attribute_ram_code_ uint8_t EPD_read_temp(void)
     return epd_temperature;
 }
 
-_attribute_ram_code_ void EPD_Display(unsigned char *image, unsigned char *red_image, int size, uint8_t full_or_partial)
+#define EPD_HASH_INIT 2166136261u // FNV-1a
+
+_attribute_ram_code_ static uint32_t epd_hash(uint32_t hash, const uint8_t *data, int len)
 {
-    if (!epd_model)
-        EPD_detect_model();
+    while (len-- > 0)
+        hash = (hash ^ *data++) * 16777619u;
+    return hash;
+}
+
+// Hash of one image plane of the job, a missing plane is sent as all 0
+_attribute_ram_code_ static uint32_t epd_plane_hash(struct epd_job *job, uint8_t plane)
+{
+    unsigned char *image = (plane & EPD_PLANE_RED) ? job->red_image : job->image;
+    uint32_t hash = EPD_HASH_INIT;
+    int i;
+
+    if (image != NULL)
+        return epd_hash(hash, image, job->size);
+    for (i = 0; i < job->size; i++)
+        hash *= 16777619u; // hash ^ 0
+    return hash;
+}
+
+// Hash the frame of the job, returns 1 if the panel already shows it. Only
+// image planes are hashed, rendering a scene a second time just for the hash
+// costs about as much as sending it. The scenes skip unchanged frames from
+// their text instead (epd_drawn_text).
+_attribute_ram_code_ static uint8_t epd_job_unchanged(void)
+{
+    epd_job.hash_valid = 0;
+    if (epd_job.render || epd_job.render_red)
+        return 0;
+    epd_job.hash[0] = epd_plane_hash(&epd_job, EPD_PLANE_BLACK);
+    epd_job.hash[1] = epd_plane_hash(&epd_job, EPD_PLANE_RED);
+    epd_job.hash_valid = 1;
+    return epd_shown_hash_valid && epd_shown_hash[0] == epd_job.hash[0] && epd_shown_hash[1] == epd_job.hash[1];
+}
+
+// hold_step is the step a direct upload waits before, 0 for a normal update
+_attribute_ram_code_ static void epd_display_start(uint8_t full_or_partial, const struct epd_window *window, uint8_t hold_step)
+{
+    uint16_t width, height;
+
+    epd_get_resolution(&width, &height);
+    if (!hold_step)
+    {
+        full_or_partial = refresh_policy_decide(full_or_partial, window, width, epd_model == 4);
+        if (full_or_partial != EPD_REFRESH_PARTIAL)
+            window = NULL; // a cleaning refresh sends the whole frame
+    }
+
+    if (hold_step)
+        epd_job.hash_valid = 0; // the frame is not known before it's uploaded
+    else if (epd_job_unchanged())
+    {
+        epd_refresh_skipped++;
+        return;
+    }
+    epd_shown_hash_valid = 0; // until the update is done
+    if (!hold_step && epd_job.image == epd_buffer)
+        epd_base_shown(EPD_BASE_BUFFER, epd_job.red_image != NULL); // the base of delta uploads
+    else
+        epd_base_shown(EPD_BASE_NONE, 0);
+    if (!hold_step)
+        refresh_policy_record(full_or_partial, window, width);
+    epd_job.start_tick = clock_time();
+    epd_job.load_ticks = 0;
+    epd_job.waveform_ms = 0;
+    epd_job.waveform_end = 0;
+    epd_job.in_waveform = 0;
 
     // puts("Trying to update EPD\r\n");
 
@@ -163,20 +303,139 @@ _attribute_ram_code_ void EPD_Display(unsigned char *image, unsigned char *red_i
     gpio_write(EPD_RESET, 1);
     WaitMs(10);
 
-    if (epd_model == 1)
-        epd_temperature = EPD_BW_213_Display(image, size, full_or_partial);
-    else if (epd_model == 2)
-        epd_temperature = EPD_BWR_213_Display_BWR(image, red_image, size, full_or_partial);
-    // else if (epd_model == 3)
-    //     epd_temperature = EPD_BWR_154_Display(image, size, full_or_partial);
-    else if (epd_model == 4)
-        epd_temperature = EPD_BW_213_ice_Display(image, size, full_or_partial);
-    else if (epd_model == 5)
-        epd_temperature = EPD_BWR_296_Display_BWR(image, red_image, size, full_or_partial);
-    // epd_temperature = EPD_BWR_296_Display(image, size, full_or_partial);
-
-    epd_temperature_is_read = 1;
+    epd_job.full_or_partial = full_or_partial;
+    epd_job.step = 0;
+    epd_job.temperature = epd_temperature;
+    epd_job.planes_sent = 0;
+    epd_job.direct = hold_step != 0;
+    epd_job.hold_step = hold_step;
+    if (window)
+        epd_job.window = *window;
+    else
+        epd_job.window.rows = 0;
+    epd_wait_ticks = 0;
     epd_update_state = 1;
+
+    // Run up to the first BUSY wait, the rest is driven from main_loop
+    epd_state_handler();
+}
+
+_attribute_ram_code_ void EPD_Display(unsigned char *image, unsigned char *red_image, int size, uint8_t full_or_partial)
+{
+    EPD_Display_window(image, red_image, size, full_or_partial, NULL);
+}
+
+// Display image planes, a window limits a partial update like in EPD_Display_render()
+_attribute_ram_code_ void EPD_Display_window(unsigned char *image, unsigned char *red_image, int size, uint8_t full_or_partial, const struct epd_window *window)
+{
+    epd_job.image = image;
+    epd_job.red_image = red_image;
+    epd_job.render = NULL;
+    epd_job.render_red = NULL;
+    epd_job.size = size;
+    epd_scene_drawn = 0;
+    epd_buffer_shown = image == epd_buffer;
+    epd_display_start(window ? 0 : full_or_partial, window, 0);
+}
+
+// Display planes drawn by render functions, a NULL render_red leaves the red plane empty.
+// A window limits a partial update to that area on panels with windowed RAM writes.
+_attribute_ram_code_ void EPD_Display_render(epd_render_fn render, epd_render_fn render_red, uint16_t width, uint8_t height, uint8_t full_or_partial, const struct epd_window *window)
+{
+    epd_job.image = NULL;
+    epd_job.red_image = NULL;
+    epd_job.render = render;
+    epd_job.render_red = render_red;
+    epd_job.width = width;
+    epd_job.height = height;
+    epd_job.size = width * height / 8;
+    epd_buffer_shown = 0;
+    epd_display_start(window ? 0 : full_or_partial, window, 0);
+}
+
+_attribute_ram_code_ uint8_t EPD_HasPlane(struct epd_job *job, uint8_t plane)
+{
+    if (plane & EPD_PLANE_RED)
+        return job->red_image != NULL || job->render_red != NULL;
+    return job->image != NULL || job->render != NULL;
+}
+
+_attribute_ram_code_ static void epd_stream(const uint8_t *data, int len, uint8_t invert)
+{
+    if (!invert)
+    {
+        EPD_StreamDataBlock(data, len);
+        return;
+    }
+    while (len-- > 0)
+        EPD_StreamData(~*data++);
+}
+
+// Draw the plane band by band into a small buffer and stream each band out
+_attribute_ram_code_ static void epd_stream_rendered(struct epd_job *job, epd_render_fn render, const struct epd_window *window, uint8_t invert)
+{
+    uint8_t band[EPD_BAND_SIZE];
+    int stride = job->height >> 3;
+    int band_rows = EPD_BAND_SIZE / stride;
+    int row = 0, end = job->width, byte = 0, bytes = stride;
+    int rows, i;
+
+    if (window != NULL)
+    {
+        row = window->row;
+        end = window->row + window->rows;
+        byte = window->byte;
+        bytes = window->bytes;
+    }
+    for (; row < end; row += rows)
+    {
+        rows = end - row;
+        if (rows > band_rows)
+            rows = band_rows;
+        obdCreateVirtualEPDBand(&obd, job->width, job->height, band, row, rows);
+        obdFill(&obd, 0, 0); // fill with white
+        render(&obd);
+        for (i = 0; i < rows; i++)
+            epd_stream(&band[i * stride + byte], bytes, invert);
+    }
+}
+
+// Send one plane of the job after cmd, from its buffer or its render function.
+// A plane that has neither is sent as all 0. With a window only that area is sent.
+_attribute_ram_code_ void EPD_LoadPlane(struct epd_job *job, uint8_t plane, uint8_t cmd, const struct epd_window *window)
+{
+    unsigned char *image = (plane & EPD_PLANE_RED) ? job->red_image : job->image;
+    epd_render_fn render = (plane & EPD_PLANE_RED) ? job->render_red : job->render;
+    uint8_t invert = (plane & EPD_PLANE_INVERT) ? 0xff : 0x00;
+    uint32_t start = clock_time();
+    int i;
+
+    if (!job->planes_sent)
+        job->load_tick = start;
+    if (job->direct)
+    { // streamed into controller RAM by the upload
+        job->planes_sent = 1;
+        return;
+    }
+
+    EPD_WriteCmd(cmd);
+    EPD_BeginDataStream();
+    if (render != NULL)
+        epd_stream_rendered(job, render, window, invert);
+    else if (image == NULL)
+        EPD_StreamDataFill(invert, window ? window->rows * window->bytes : job->size);
+    else if (window != NULL)
+    {
+        for (i = 0; i < window->rows; i++)
+            epd_stream(&image[(window->row + i) * window->stride + window->byte], window->bytes, invert);
+    }
+    else
+        epd_stream(image, job->size, invert);
+    EPD_EndDataStream();
+    epd_spi_busy_ticks += clock_time() - start;
+    job->load_ticks += clock_time() - start;
+    job->planes_sent = 1; // all planes of a job are sent in the same step
+    WaitMs(2);
 }
 
 _attribute_ram_code_ void epd_set_sleep(void)
@@ -197,90 +456,339 @@ _attribute_ram_code_ void epd_set_sleep(void)
     epd_update_state = 0;
 }
 
+// UC8151 style controllers pull BUSY low while working, the SSD168x ones drive it high
+_attribute_ram_code_ uint8_t epd_busy_wakeup_level(void)
+{
+    if (epd_model == 1 || epd_model == 2)
+        return 1;
+    return 0;
+}
+
+_attribute_ram_code_ static uint8_t epd_controller_busy(void)
+{
+    if (epd_busy_wakeup_level())
+        return EPD_IS_BUSY();
+    return !EPD_IS_BUSY();
+}
+
+_attribute_ram_code_ static uint16_t epd_display_step(void)
+{
+    if (epd_model == 1)
+        return EPD_BW_213_Display_step(&epd_job);
+    else if (epd_model == 2)
+        return EPD_BWR_213_Display_BWR_step(&epd_job);
+    // else if (epd_model == 3)
+    //     return EPD_BWR_154_Display_step(&epd_job);
+    else if (epd_model == 4)
+        return EPD_BW_213_ice_Display_step(&epd_job);
+    else if (epd_model == 5)
+        return EPD_BWR_296_Display_step(&epd_job);
+    return 0;
+}
+
+// Add the phases of a finished update to the timing statistics. A direct
+// upload was held before the plane load, so only its waveform and sleep count.
+_attribute_ram_code_ static void epd_timing_job_done(void)
+{
+    uint8_t mode = EPD_TIMING_PARTIAL;
+
+    if (epd_job.full_or_partial == EPD_REFRESH_FAST)
+        mode = EPD_TIMING_FAST;
+    else if (epd_job.full_or_partial)
+        mode = (epd_model == 2 || epd_model == 3 || epd_model == 5) ? EPD_TIMING_BWR : EPD_TIMING_FULL;
+
+    if (!epd_job.direct)
+    {
+        epd_timing_add(mode, EPD_TIMING_POWER, (epd_job.load_tick - epd_job.start_tick) / CLOCK_16M_SYS_TIMER_CLK_1MS);
+        epd_timing_add(mode, EPD_TIMING_LOAD, epd_job.load_ticks / CLOCK_16M_SYS_TIMER_CLK_1MS);
+    }
+    if (!epd_job.waveform_end)
+        return; // no waveform wait, nothing to time the sleep from
+    epd_timing_add(mode, EPD_TIMING_WAVEFORM, epd_job.waveform_ms);
+    epd_timing_add(mode, EPD_TIMING_SLEEP, (clock_time() - epd_job.waveform_end) / CLOCK_16M_SYS_TIMER_CLK_1MS);
+}
+
 _attribute_ram_code_ uint8_t epd_state_handler(void)
 {
-    switch (epd_update_state)
+    uint16_t wait_ms;
+
+    while (epd_update_state)
     {
-    case 0:
-        // Nothing todo
-        break;
-    case 1: // check if refresh is done and sleep epd if so
-        if (epd_model == 1)
+        if (epd_wait_ticks)
         {
-            if (!EPD_IS_BUSY())
-                epd_set_sleep();
+            if (epd_controller_busy())
+            {
+                if (clock_time() - epd_wait_start < epd_wait_ticks)
+                    break; // still working, main_loop suspends until BUSY changes
+                puts("Busy timeout\r\n");
+            }
+            if (epd_job.in_waveform)
+            {
+                epd_job.waveform_end = clock_time();
+                epd_job.waveform_ms = (epd_job.waveform_end - epd_wait_start) / CLOCK_16M_SYS_TIMER_CLK_1MS;
+                epd_job.in_waveform = 0;
+            }
+            epd_wait_ticks = 0;
         }
-        else
-        {
-            if (EPD_IS_BUSY())
-                epd_set_sleep();
+        if (epd_job.hold_step && epd_job.step == epd_job.hold_step)
+            break; // the planes are still being uploaded
+
+        wait_ms = epd_display_step();
+        if (!wait_ms)
+        { // sequence done, put the display to sleep
+            epd_shown_hash[0] = epd_job.hash[0];
+            epd_shown_hash[1] = epd_job.hash[1];
+            epd_shown_hash_valid = epd_job.hash_valid;
+            epd_refresh_done++;
+            if (epd_model == 5)
+                EPD_BWR_296_refresh_done(epd_job.waveform_ms);
+            epd_temperature = epd_job.temperature;
+            epd_temperature_is_read = 1;
+            epd_set_sleep();
+            epd_timing_job_done();
+            break;
         }
-        break;
+        WaitMs(1); // give the controller time to raise BUSY
+        epd_job.in_waveform = wait_ms == EPD_REFRESH_WAIT_MS;
+        epd_wait_start = clock_time();
+        epd_wait_ticks = wait_ms * CLOCK_16M_SYS_TIMER_CLK_1MS;
     }
     return epd_update_state;
 }
 
-_attribute_ram_code_ void FixBuffer(uint8_t *pSrc, uint8_t *pDst, uint16_t width, uint16_t height)
+// The controller RAM holds the image of a running update once its planes are
+// sent, from then on the buffers are the back buffer for the next upload while
+// the waveform runs. Before that they still belong to the update.
+_attribute_ram_code_ uint8_t epd_planes_pending(void)
 {
-    int x, y;
-    uint8_t *s, *d;
-    for (y = 0; y < (height / 8); y++)
-    { // byte rows
-        d = &pDst[y];
-        s = &pSrc[y * width];
-        for (x = 0; x < width; x++)
-        {
-            d[x * (height / 8)] = ~ucMirror[s[width - 1 - x]]; // invert and flip
-        } // for x
-    } // for y
+    return epd_update_state && !epd_job.planes_sent && (epd_job.image || epd_job.red_image);
 }
 
+// Updates run to the end and updates skipped because the frame was already shown
+void epd_get_refresh_stats(uint32_t *done, uint32_t *skipped)
+{
+    *done = epd_refresh_done;
+    *skipped = epd_refresh_skipped;
+}
+
+void epd_reset_refresh_stats(void)
+{
+    epd_refresh_done = 0;
+    epd_refresh_skipped = 0;
+}
+
+// Direct upload on SSD168x panels, which keep both planes in their own RAM:
+// the update is started first and held before the step that would load the
+// planes, the uploaded data goes straight to RAM commands 0x24/0x26 and
+// releasing the hold runs only the waveform. Returns the step that loads
+// the planes, 0 if the panel has no such RAM.
+_attribute_ram_code_ static uint8_t epd_direct_plane_step(void)
+{
+    if (epd_model == 4)
+        return 3;
+    if (epd_model == 5)
+        return 2;
+    return 0;
+}
+
+// Start an update that waits for a direct upload, returns 0 if the panel is busy or unsuitable
+_attribute_ram_code_ uint8_t epd_direct_begin(void)
+{
+    if (!epd_model)
+        EPD_detect_model();
+    if (epd_update_state || !epd_direct_plane_step())
+        return 0;
+    epd_job.image = NULL;
+    epd_job.red_image = NULL;
+    epd_job.render = NULL;
+    epd_job.render_red = NULL;
+    epd_job.size = epd_get_plane_size();
+    epd_scene_drawn = 0;
+    epd_buffer_shown = 0;
+    epd_display_start(1, NULL, epd_direct_plane_step());
+    return 1;
+}
+
+_attribute_ram_code_ uint8_t epd_direct_active(void)
+{
+    return epd_update_state && epd_job.hold_step;
+}
+
+// The controller is initialised and takes plane data
+_attribute_ram_code_ uint8_t epd_direct_ready(void)
+{
+    return epd_direct_active() && epd_job.step == epd_job.hold_step && !epd_wait_ticks;
+}
+
+// Select the plane the next epd_direct_write() data goes to, from its first byte
+_attribute_ram_code_ uint8_t epd_direct_plane(uint8_t red)
+{
+    if (!epd_direct_ready() || (red && epd_model != 5))
+        return 0;
+    if (epd_model == 4)
+        EPD_BW_213_ice_set_ram_start();
+    else
+        EPD_BWR_296_set_ram_start();
+    EPD_WriteCmd(red ? 0x26 : 0x24);
+    return 1;
+}
+
+_attribute_ram_code_ void epd_direct_write(const uint8_t *data, int len)
+{
+    uint32_t start = clock_time();
+
+    EPD_BeginDataStream();
+    EPD_StreamDataBlock(data, len);
+    EPD_EndDataStream();
+    epd_spi_busy_ticks += clock_time() - start;
+}
+
+// Release the hold, main_loop runs the rest of the update
+_attribute_ram_code_ void epd_direct_show(uint8_t full_or_partial)
+{
+    uint16_t width, height;
+
+    epd_get_resolution(&width, &height);
+    full_or_partial = refresh_policy_decide(full_or_partial, NULL, width, epd_model == 4);
+    refresh_policy_record(full_or_partial, NULL, width);
+    epd_job.full_or_partial = full_or_partial;
+    epd_job.hold_step = 0;
+}
+
+_attribute_ram_code_ void epd_direct_abort(void)
+{
+    if (epd_direct_active())
+        epd_set_sleep();
+}
+
+// Draws the black runs of one decoded line. Image lines run along the panel
+// RAM columns, so a run only touches its own pixels and white is skipped.
 _attribute_ram_code_ void TIFFDraw(TIFFDRAW *pDraw)
 {
-    uint8_t uc = 0, ucSrcMask, ucDstMask, *s, *d;
-    int x, y;
+    int16_t *flips = pDraw->pFlips;
+    uint8_t mask = ~(0x80 >> (pDraw->y & 7));
+    uint8_t *col = &epd_buffer[(pDraw->iWidth - 1) * epd_tiff_stride + (pDraw->y >> 3)];
+    uint8_t *d;
+    int x, x_end;
 
-    s = pDraw->pPixels;
-    y = pDraw->y;                          // current line
-    d = &epd_buffer[(249 * 16) + (y / 8)]; // rotated 90 deg clockwise
-    ucDstMask = 0x80 >> (y & 7);           // destination mask
-    ucSrcMask = 0;                         // src mask
-    for (x = 0; x < pDraw->iWidth; x++)
+    for (;;)
     {
-        // Slower to draw this way, but it allows us to use a single buffer
-        // instead of drawing and then converting the pixels to be the EPD format
-        if (ucSrcMask == 0)
-        { // load next source byte
-            ucSrcMask = 0x80;
-            uc = *s++;
-        }
-        if (!(uc & ucSrcMask))
-        { // black pixel
-            d[-(x * 16)] &= ~ucDstMask;
-        }
-        ucSrcMask >>= 1;
+        x = *flips++;
+        x_end = *flips++;
+        if (x >= pDraw->iWidth || x_end <= x)
+            break;
+        if (x_end > pDraw->iWidth)
+            x_end = pDraw->iWidth;
+        d = col - x * epd_tiff_stride;
+        for (; x < x_end; x++, d -= epd_tiff_stride)
+            *d &= mask;
     }
 }
 
+// Image size for the connected panel, without the padding rows
+_attribute_ram_code_ static void epd_tiff_open_geometry(uint16_t *width, uint16_t *height)
+{
+    epd_get_resolution(width, height);
+    epd_tiff_stride = *height / 8;
+    if (*width == 250)
+        *height = 122;
+}
+
+// Decode a whole G4 file into epd_buffer and show it. Data uploaded with 0x03
+// sits in epd_buffer itself, it is moved to the unused red plane first.
 _attribute_ram_code_ void epd_display_tiff(uint8_t *pData, int iSize)
 {
-    // test G4 decoder
-    epd_clear();
-    TIFF_openRAW(&tiff, 250, 122, BITDIR_MSB_FIRST, pData, iSize, TIFFDraw);
-    TIFF_setDrawParameters(&tiff, 65536, TIFF_PIXEL_1BPP, 0, 0, 250, 122, NULL);
+    uint16_t width, height;
+
+    if (iSize > epd_buffer_size)
+        iSize = epd_buffer_size;
+    if (pData == epd_buffer)
+    {
+        memcpy(epd_buffer_red, epd_buffer, iSize);
+        pData = epd_buffer_red;
+    }
+    epd_tiff_open_geometry(&width, &height);
+    memset(epd_buffer, 0xff, epd_buffer_size); // white, the decoder only draws black
+    TIFF_openRAW(&tiff, width, height, BITDIR_MSB_FIRST, pData, iSize, TIFFDraw);
+    TIFF_setDrawParameters(&tiff, 65536, TIFF_PIXEL_SPANS, 0, 0, width, height, NULL);
     TIFF_decode(&tiff);
     TIFF_close(&tiff);
-    EPD_Display(epd_buffer, NULL, epd_buffer_size, 1);
+    memset(epd_buffer_red, 0x00, epd_buffer_size);
+    EPD_Display(epd_buffer, NULL, epd_get_plane_size(), 1);
+}
+
+// Show an image stored with epd_slot_write() instead of a scene, returns 0
+// if the slot is empty or the panel is busy
+_attribute_ram_code_ uint8_t epd_display_slot(uint8_t slot, uint8_t full_or_partial)
+{
+    if (epd_update_state)
+        return 0;
+    epd_buffer_shown = 0;
+    epd_base_release();
+    if (!epd_slot_load(slot))
+        return 0;
+    epd_scene = 0;
+    EPD_Display(epd_buffer, epd_buffer_red, epd_get_plane_size(), full_or_partial);
+    epd_base_shown(slot, 1); // the slot is the base, no copy needed
+    return 1;
+}
+
+// Like epd_display_slot(), but waits for a running update to finish
+void epd_show_slot(uint8_t slot, uint8_t full_or_partial)
+{
+    epd_scene = 0;
+    epd_pending_slot = slot;
+    epd_pending_slot_full = full_or_partial;
+}
+
+// Streamed variant: G4 data is decoded straight into epd_buffer as the chunks
+// arrive, so the compressed file is never held in RAM. Returns 0 if the
+// decoder can't take lines of the panel width.
+_attribute_ram_code_ uint8_t epd_tiff_stream_start(void)
+{
+    uint16_t width, height;
+
+    epd_tiff_open_geometry(&width, &height);
+    memset(epd_buffer, 0xff, epd_buffer_size); // white, the decoder only draws black
+    if (!TIFF_openPush(&tiff, width, height, BITDIR_MSB_FIRST, TIFFDraw))
+        return 0;
+    TIFF_setDrawParameters(&tiff, 65536, TIFF_PIXEL_SPANS, 0, 0, width, height, NULL);
+    return 1;
+}
+
+_attribute_ram_code_ int epd_tiff_stream_feed(const uint8_t *data, int len)
+{
+    if (!TIFF_pushData(&tiff, data, len))
+        return -1;
+    return TIFF_getLinesDecoded(&tiff);
+}
+
+_attribute_ram_code_ void epd_tiff_stream_end(void)
+{
+    TIFF_pushEnd(&tiff);
+    TIFF_close(&tiff);
+    EPD_Display(epd_buffer, NULL, epd_get_plane_size(), 1);
 }
 
 extern uint8_t mac_public[6];
-_attribute_ram_code_ void epd_display(struct date_time _time, uint16_t battery_mv, int16_t temperature, uint8_t full_or_partial)
+
+_attribute_ram_code_ static void epd_render_default(OBDISP *pOBD)
 {
-    uint8_t battery_level;
+    obdWriteStringCustom(pOBD, (GFXfont *)&Dialog_plain_16, 1, 17, epd_scene_text[EPD_LINE_NAME], 1);
+    obdWriteStringCustom(pOBD, (GFXfont *)&Dialog_plain_16, 232, 20, epd_scene_text[EPD_LINE_BLE], 1);
+    obdWriteStringCustom(pOBD, (GFXfont *)&Special_Elite_Regular_30, 10, 95, epd_scene_text[EPD_LINE_TEMPERATURE], 1);
+    obdWriteStringCustom(pOBD, (GFXfont *)&Dialog_plain_16, 10, 120, epd_scene_text[EPD_LINE_BATTERY], 1);
+}
 
-    if (epd_update_state)
-        return;
+_attribute_ram_code_ static void epd_render_default_red(OBDISP *pOBD)
+{
+    obdRectangle(pOBD, 0, 90, 249, 121, 1, 0);
+    obdWriteStringCustom(pOBD, (GFXfont *)&DSEG14_Classic_Mini_Regular_40, 75, 65, epd_scene_text[EPD_LINE_TIME], 1);
+}
 
+// Panel size in pixels, the height rounded up to full bytes
+_attribute_ram_code_ void epd_get_resolution(uint16_t *width, uint16_t *height)
+{
     if (!epd_model)
     {
         EPD_detect_model();
@@ -312,37 +820,49 @@ _attribute_ram_code_ void epd_display(struct date_time _time, uint16_t battery_m
         resolution_w = 296;
         resolution_h = 128;
     }
+    *width = resolution_w;
+    *height = resolution_h;
+}
 
-    epd_clear();
-
-    // Draw BLACK layer
-    obdCreateVirtualDisplay(&obd, resolution_w, resolution_h, epd_temp);
-    obdFill(&obd, 0, 0); // fill with white
+// Bytes of one plane row (panel RAM column) of the connected panel
+_attribute_ram_code_ uint8_t epd_get_plane_stride(void)
+{
+    uint16_t width, height;
 
-    char buff[100];
-    battery_level = get_battery_level(battery_mv);
-    sprintf(buff, "THX_%02X%02X%02X %s", mac_public[2], mac_public[1], mac_public[0], epd_model_string[epd_model]);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 1, 17, (char *)buff, 1);
-    sprintf(buff, "%s", BLE_conn_string[ble_get_connected()]);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 232, 20, (char *)buff, 1);
+    epd_get_resolution(&width, &height);
+    return height / 8;
+}
 
-    sprintf(buff, "-----%d'C-----", EPD_read_temp());
-    obdWriteStringCustom(&obd, (GFXfont *)&Special_Elite_Regular_30, 10, 95, (char *)buff, 1);
-    sprintf(buff, "Battery %dmV  %d%%", battery_mv, battery_level);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 10, 120, (char *)buff, 1);
+// Bytes of one image plane of the connected panel
+_attribute_ram_code_ int epd_get_plane_size(void)
+{
+    uint16_t width, height;
 
-    FixBuffer(epd_temp, epd_buffer, resolution_w, resolution_h);
+    epd_get_resolution(&width, &height);
+    if (width * (height / 8) > epd_buffer_size)
+        return epd_buffer_size;
+    return width * (height / 8);
+}
 
-    // Draw RED layer
-    obdFill(&obd, 0, 0); // fill with white
+_attribute_ram_code_ void epd_display(struct date_time _time, uint16_t battery_mv, int16_t temperature, uint8_t full_or_partial)
+{
+    uint8_t battery_level;
+    uint16_t resolution_w, resolution_h;
 
-    obdRectangle(&obd, 0, 90, 249, 121, 1, 0);
+    if (epd_update_state)
+        return;
 
-    sprintf(buff, "%02d:%02d", _time.tm_hour, _time.tm_min);
-    obdWriteStringCustom(&obd, (GFXfont *)&DSEG14_Classic_Mini_Regular_40, 75, 65, (char *)buff, 1);
+    epd_get_resolution(&resolution_w, &resolution_h);
 
-    FixBuffer(epd_temp, epd_buffer_red, resolution_w, resolution_h);
-    EPD_Display(epd_buffer, epd_buffer_red, resolution_w * resolution_h / 8, full_or_partial);
+    battery_level = get_battery_level(battery_mv);
+    sprintf(epd_scene_text[EPD_LINE_NAME], "THX_%02X%02X%02X %s", mac_public[2], mac_public[1], mac_public[0], epd_model_string[epd_model]);
+    sprintf(epd_scene_text[EPD_LINE_BLE], "%s", BLE_conn_string[ble_get_connected()]);
+    sprintf(epd_scene_text[EPD_LINE_TEMPERATURE], "-----%d'C-----", EPD_read_temp());
+    sprintf(epd_scene_text[EPD_LINE_BATTERY], "Battery %dmV  %d%%", battery_mv, battery_level);
+    sprintf(epd_scene_text[EPD_LINE_TIME], "%02d:%02d", _time.tm_hour, _time.tm_min);
+
+    epd_scene_drawn = 1;
+    EPD_Display_render(epd_render_default, epd_render_default_red, resolution_w, resolution_h, full_or_partial, NULL);
 }
 
 _attribute_ram_code_ void epd_display_char(uint8_t data)
@@ -352,14 +872,15 @@ _attribute_ram_code_ void epd_display_char(uint8_t data)
     {
         epd_buffer[i] = data;
     }
-    EPD_Display(epd_buffer, NULL, epd_buffer_size, 1);
+    EPD_Display(epd_buffer, NULL, epd_get_plane_size(), 1);
 }
 
 _attribute_ram_code_ void epd_clear(void)
 {
     memset(epd_buffer, 0x00, epd_buffer_size);
     memset(epd_buffer_red, 0x00, epd_buffer_size);
-    memset(epd_temp, 0x00, epd_buffer_size);
+    epd_buffer_shown = 0;
+    epd_base_release();
 }
 
 void update_time_scene(struct date_time _time, uint16_t battery_mv, int16_t temperature, void (*scene)(struct date_time, uint16_t, int16_t, uint8_t))
@@ -382,17 +903,9 @@ void update_time_scene(struct date_time _time, uint16_t battery_mv, int16_t temp
     }
 
     else if (_time.tm_min != minute_refresh)
-    {
+    { // refresh_policy_decide() cleans the panel when it needs it
         minute_refresh = _time.tm_min;
-        if (_time.tm_hour != hour_refresh)
-        {
-            hour_refresh = _time.tm_hour;
-            scene(_time, battery_mv, temperature, 1);
-        }
-        else
-        {
-            scene(_time, battery_mv, temperature, 0);
-        }
+        scene(_time, battery_mv, temperature, EPD_REFRESH_PARTIAL);
     }
 }
 
@@ -407,65 +920,105 @@ void epd_update(struct date_time _time, uint16_t battery_mv, int16_t temperature
         update_time_scene(_time, battery_mv, temperature, epd_display_time_with_date);
         break;
     default:
+        if (epd_pending_slot != 0xff && !epd_update_state)
+        {
+            epd_display_slot(epd_pending_slot, epd_pending_slot_full);
+            epd_pending_slot = 0xff;
+        }
         break;
     }
 }
 
-void epd_display_time_with_date(struct date_time _time, uint16_t battery_mv, int16_t temperature, uint8_t full_or_partial)
+_attribute_ram_code_ static void epd_render_time_with_date(OBDISP *pOBD)
 {
-    uint16_t battery_level;
-
-    // Clear all working buffers (black, red, temp)
-    epd_clear();
-
-    // Create a virtual monochrome drawing surface the size of the panel
-    obdCreateVirtualDisplay(&obd, epd_width, epd_height, epd_temp);
-    obdFill(&obd, 0, 0); // fill with white (1 = black pixel when finally inverted for panel)
-
-    char buff[100];
-    battery_level = get_battery_level(battery_mv);
+    const struct epd_text_field *f;
+    int i;
 
     // Device identifier (partial MAC)
-    sprintf(buff, "THX_%02X%02X%02X", mac_public[2], mac_public[1], mac_public[0]);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 1, 17, (char *)buff, 1);
+    obdWriteStringCustom(pOBD, (GFXfont *)&Dialog_plain_16, 1, 17, epd_scene_text[EPD_FIELD_NAME], 1);
 
     // Battery icon rectangle
-    obdRectangle(&obd, 225, 2, 249, 22, 1, 1);
-
-    // Battery percentage inside battery outline (drawn white on black fill)
-    sprintf(buff, "%d", battery_level);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 219, 18, (char *)buff, 0);
+    obdRectangle(pOBD, 225, 2, 249, 22, 1, 1);
 
     // Separator bar under header
-    obdRectangle(&obd, 0, 25, 249, 27, 1, 1);
-
-    // Time (HH:MM) big segmented font
-    sprintf(buff, "%02d:%02d", _time.tm_hour, _time.tm_min);
-    obdWriteStringCustom(&obd, (GFXfont *)&DSEG14_Classic_Mini_Regular_40, 35, 85, (char *)buff, 1);
-
-    // Temperature (from EPD sensor, not the passed temperature param)
-    sprintf(buff, "%d'C", epd_temperature);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 216, 50, (char *)buff, 1);
+    obdRectangle(pOBD, 0, 25, 249, 27, 1, 1);
 
     // Small separator line under temperature
-    obdRectangle(&obd, 216, 60, 249, 62, 1, 1);
-
-    // Battery voltage in mV
-    sprintf(buff, " %dmV", battery_mv);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 216, 84, (char *)buff, 1);
+    obdRectangle(pOBD, 216, 60, 249, 62, 1, 1);
 
     // Vertical separator at right info block
-    obdRectangle(&obd, 214, 27, 216, 99, 1, 1);
+    obdRectangle(pOBD, 214, 27, 216, 99, 1, 1);
     // Horizontal footer separator
-    obdRectangle(&obd, 0, 97, 249, 99, 1, 1);
+    obdRectangle(pOBD, 0, 97, 249, 99, 1, 1);
 
-    // Date (YYYY-MM-DD)
-    sprintf(buff, "%d-%02d-%02d", _time.tm_year, _time.tm_month, _time.tm_day);
-    obdWriteStringCustom(&obd, (GFXfont *)&Dialog_plain_16, 10, 120, (char *)buff, 1);
+    for (i = 0; i < EPD_FIELD_COUNT; i++)
+    {
+        f = &epd_date_fields[i];
+        obdWriteStringCustom(pOBD, (GFXfont *)f->font, f->x, f->y, epd_scene_text[i], f->color);
+    }
+}
+
+// Mark on pOBD where a field differs from what the panel shows: the old and
+// the new string from the first character that changed
+_attribute_ram_code_ static void epd_mark_field_change(OBDISP *pOBD, int field)
+{
+    const struct epd_text_field *f = &epd_date_fields[field];
+    char *drawn = epd_drawn_text[field];
+    char *text = epd_scene_text[field];
+    char prefix[EPD_TEXT_LEN];
+    int i = 0, x, width, top, bottom;
+
+    while (drawn[i] && drawn[i] == text[i])
+        i++;
+    if (!drawn[i] && !text[i])
+        return; // unchanged
+
+    x = f->x;
+    if (i)
+    {
+        memcpy(prefix, text, i);
+        prefix[i] = 0;
+        obdGetStringBox((GFXfont *)f->font, prefix, &width, &top, &bottom);
+        x += width;
+    }
+    obdWriteStringCustom(pOBD, (GFXfont *)f->font, x, f->y, drawn + i, 1);
+    obdWriteStringCustom(pOBD, (GFXfont *)f->font, x, f->y, text + i, 1);
+}
 
-    // Convert drawing buffer into panel memory layout
-    FixBuffer(epd_temp, epd_buffer, epd_width, epd_height);
+void epd_display_time_with_date(struct date_time _time, uint16_t battery_mv, int16_t temperature, uint8_t full_or_partial)
+{
+    struct epd_window window;
+    uint8_t none;
+    int x1, y1, x2, y2;
+    // A partial update only sends the area where the fields differ from the previous frame
+    uint8_t incremental = !full_or_partial && epd_scene_drawn == 2;
+
+    sprintf(epd_scene_text[EPD_FIELD_NAME], "THX_%02X%02X%02X", mac_public[2], mac_public[1], mac_public[0]);
+    sprintf(epd_scene_text[EPD_FIELD_LEVEL], "%d", get_battery_level(battery_mv));
+    sprintf(epd_scene_text[EPD_FIELD_TIME], "%02d:%02d", _time.tm_hour, _time.tm_min);
+    // Temperature (from EPD sensor, not the passed temperature param)
+    sprintf(epd_scene_text[EPD_FIELD_TEMPERATURE], "%d'C", epd_temperature);
+    sprintf(epd_scene_text[EPD_FIELD_VOLTAGE], " %dmV", battery_mv);
+    sprintf(epd_scene_text[EPD_FIELD_DATE], "%d-%02d-%02d", _time.tm_year, _time.tm_month, _time.tm_day);
+
+    if (incremental)
+    {
+        // A band without rows only collects the area the changed text covers
+        obdCreateVirtualEPDBand(&obd, epd_width, epd_height, &none, 0, 0);
+        for (x1 = 0; x1 < EPD_FIELD_COUNT; x1++)
+            epd_mark_field_change(&obd, x1);
+        if (!obdGetDirtyRect(&obd, &x1, &y1, &x2, &y2))
+            return; // the panel already shows this frame
+
+        window.stride = epd_height >> 3;
+        window.row = epd_width - 1 - x2; // rows start at the right edge
+        window.rows = x2 - x1 + 1;
+        window.byte = y1 >> 3;
+        window.bytes = (y2 >> 3) - (y1 >> 3) + 1;
+    }
+    memcpy(epd_drawn_text, epd_scene_text, sizeof(epd_drawn_text));
+    epd_scene_drawn = 2;
 
     // Send to panel (black-only layer)
-    EPD_Display(epd_buffer, NULL, epd_width * epd_height / 8, full_or_partial);
+    EPD_Display_render(epd_render_time_with_date, NULL, epd_width, epd_height, full_or_partial, incremental ? &window : NULL);
 }
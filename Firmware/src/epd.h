@@ -2,10 +2,64 @@
 #include "etime.h"
 #define epd_height 128
 #define epd_width 250
-#define epd_buffer_size 4000 // ((epd_height/8) * epd_width)
+#define epd_max_width 296                                  // widest supported panel, BWR296
+#define epd_buffer_size ((epd_height / 8) * epd_max_width) // one plane of the largest panel
+
+// Scenes are not kept in frame buffers, they are drawn again for every band of
+// panel rows that fits in EPD_BAND_SIZE bytes while the planes are streamed out
+#define EPD_BAND_SIZE 256
+
+// A display update is split into steps at every BUSY wait. A panel driver's
+// *_Display_step() runs job->step, advances it and returns how many ms to wait
+// at most for the controller before the next step, or 0 once the sequence is done.
+#define EPD_BUSY_WAIT_MS 100
+#define EPD_REFRESH_WAIT_MS 30000
+
+// Part of the image buffers to upload, in panel layout: a run of rows (one per
+// x column, counted from the right edge) and of bytes within each row.
+// rows == 0 uploads the whole image.
+struct epd_window
+{
+    uint16_t row;
+    uint16_t rows;
+    uint8_t byte;
+    uint8_t bytes;
+    uint8_t stride;
+};
+
+struct obdstruct;
+typedef void (*epd_render_fn)(struct obdstruct *pOBD);
+
+struct epd_job
+{
+    unsigned char *image;
+    unsigned char *red_image;
+    epd_render_fn render;     // draws the black plane instead of image when set
+    epd_render_fn render_red; // draws the red plane instead of red_image when set
+    uint16_t width;           // size of the rendered planes
+    uint8_t height;
+    int size;
+    uint8_t full_or_partial;
+    uint8_t step;
+    uint8_t temperature;
+    uint8_t planes_sent; // the planes are in controller RAM, image and red_image may take the next one
+    uint8_t direct;      // the planes were streamed into controller RAM by the upload, see epd_direct_begin()
+    uint8_t hold_step;   // a direct upload is running while the job waits before this step, 0 = none
+    uint8_t hash_valid;  // hash holds the frame of the job, see epd_job_unchanged()
+    uint32_t hash[2];    // per plane, black and red
+    // Phase timing for epd_timing.c, in clock_time() ticks
+    uint32_t start_tick;    // epd_display_start()
+    uint32_t load_tick;     // first EPD_LoadPlane()
+    uint32_t load_ticks;    // spent in EPD_LoadPlane()
+    uint32_t waveform_end;  // the waveform BUSY wait ended
+    uint16_t waveform_ms;
+    uint8_t in_waveform;    // the running BUSY wait is the waveform, EPD_REFRESH_WAIT_MS
+    struct epd_window window;
+};
 
 void set_EPD_model(uint8_t model_nr);
 void set_EPD_scene(uint8_t scene);
+void set_EPD_scene_refresh(uint8_t scene, uint8_t full_refresh);
 void set_EPD_wait_flush();
 
 void init_epd(void);
@@ -18,11 +72,39 @@ void EPD_Display_color_change();
 void EPD_Display_end();
 
 void EPD_Display(unsigned char *image, unsigned char * red_image, int size, uint8_t full_or_partial);
+void EPD_Display_window(unsigned char *image, unsigned char *red_image, int size, uint8_t full_or_partial, const struct epd_window *window);
+void EPD_Display_render(epd_render_fn render, epd_render_fn render_red, uint16_t width, uint8_t height, uint8_t full_or_partial, const struct epd_window *window);
+
+// Plane selection for EPD_LoadPlane
+#define EPD_PLANE_BLACK 0x00
+#define EPD_PLANE_RED 0x01
+#define EPD_PLANE_INVERT 0x80 // send the plane bitwise inverted
+uint8_t EPD_HasPlane(struct epd_job *job, uint8_t plane);
+void EPD_LoadPlane(struct epd_job *job, uint8_t plane, uint8_t cmd, const struct epd_window *window);
 void epd_display_tiff(uint8_t *pData, int iSize);
+uint8_t epd_display_slot(uint8_t slot, uint8_t full_or_partial);
+void epd_show_slot(uint8_t slot, uint8_t full_or_partial);
+uint8_t epd_tiff_stream_start(void);
+int epd_tiff_stream_feed(const uint8_t *data, int len);
+void epd_tiff_stream_end(void);
 void epd_set_sleep(void);
 uint8_t epd_state_handler(void);
+uint8_t epd_planes_pending(void);
+void epd_get_refresh_stats(uint32_t *done, uint32_t *skipped);
+void epd_reset_refresh_stats(void);
+uint8_t epd_direct_begin(void);
+uint8_t epd_direct_active(void);
+uint8_t epd_direct_ready(void);
+uint8_t epd_direct_plane(uint8_t red);
+void epd_direct_write(const uint8_t *data, int len);
+void epd_direct_show(uint8_t full_or_partial);
+void epd_direct_abort(void);
+uint8_t epd_busy_wakeup_level(void);
 void epd_display_char(uint8_t data);
 void epd_clear(void);
+void epd_get_resolution(uint16_t *width, uint16_t *height);
+int epd_get_plane_size(void);
+uint8_t epd_get_plane_stride(void);
 
 void update_time_scene(struct date_time _time, uint16_t battery_mv, int16_t temperature, void (*scene)(struct date_time, uint16_t, int16_t,  uint8_t));
 void epd_update(struct date_time _time, uint16_t battery_mv, int16_t temperature);
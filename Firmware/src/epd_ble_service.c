@@ -5,9 +5,13 @@
 #include "stack/ble/ble.h"
 
 #include "epd.h"
+#include "epd_lz.h"
+#include "epd_slot.h"
+#include "epd_bwr_296.h"
 #include "ble.h"
+#include "work_queue.h"
 
-extern uint8_t epd_temp[epd_buffer_size];
+extern uint8_t epd_buffer_red[epd_buffer_size];
 
 #define ASSERT_MIN_LEN(val, min_len) \
 	if (val < min_len)               \
@@ -16,7 +20,156 @@ extern uint8_t epd_temp[epd_buffer_size];
 	}
 
 extern uint8_t epd_buffer[epd_buffer_size];
+extern uint8_t epd_buffer_shown;
+extern uint8_t epd_update_state;
 unsigned int byte_pos = 0;
+RAM uint8_t epd_upload_active = 0;
+RAM struct epd_lz epd_lz;
+RAM uint8_t epd_lz_started = 0;
+RAM uint8_t epd_lz_plane; // plane code of the running decoder
+RAM uint8_t epd_tiff_started = 0;
+RAM uint8_t epd_tiff_failed = 0; // the decoder refused the stream, 0x04 must not show it
+
+// Bulk transfer of one plane (commands 0x07-0x09): chunks are written without
+// response and acknowledged in batches. The ack (0x09) carries the first
+// missing chunk, one past the highest chunk received and a bitmap of the
+// missing chunks in between.
+#define EPD_BULK_MAX_CHUNKS 512
+#define EPD_BULK_ACK_CHUNKS 64
+uint8_t epd_bulk_seen[EPD_BULK_MAX_CHUNKS / 8];
+RAM uint8_t *epd_bulk_plane;
+RAM uint16_t epd_bulk_chunks; // chunks in the transfer, 0 when none is running
+RAM uint16_t epd_bulk_base;   // first chunk not received yet
+RAM uint16_t epd_bulk_top;    // one past the highest chunk received
+RAM uint8_t epd_bulk_chunk_size;
+RAM uint8_t epd_bulk_ack_every;
+RAM uint8_t epd_bulk_since_ack;
+
+// Direct upload (command 0x0F, then 0x03 and 0x01): on SSD168x panels the
+// chunks go straight into the controller RAM of an update held for them
+RAM uint16_t epd_direct_pos; // next plane byte, chunks must arrive in order
+RAM uint8_t epd_direct_plane_set = 0;
+
+// Delta upload (commands 0x0A/0x0B): XOR patches against the planes of the
+// image on the panel, the patched area becomes the refresh window
+uint8_t epd_delta_active = 0;
+uint16_t epd_delta_first, epd_delta_last; // changed plane rows
+uint8_t epd_delta_byte_first, epd_delta_byte_last; // changed bytes within a row
+
+// The image planes are not in retention RAM, so between the first write and
+// the display command deep retention sleep must not be used
+_attribute_ram_code_ uint8_t epd_ble_upload_active(void)
+{
+	return epd_upload_active;
+}
+
+_attribute_ram_code_ void epd_ble_upload_reset(void)
+{
+	epd_upload_active = 0;
+	epd_tiff_started = 0;
+	epd_tiff_failed = 0;
+	epd_bulk_chunks = 0;
+	epd_direct_plane_set = 0;
+	epd_direct_abort();
+	if (epd_delta_active)
+	{ // patched planes that were never shown
+		epd_delta_active = 0;
+		epd_buffer_shown = 0;
+		epd_base_release();
+	}
+}
+
+// Refreshes requested over BLE run from main_loop (work_queue.c), once the
+// panel is idle. The planes stay protected from deep retention until then.
+_attribute_ram_code_ static uint8_t epd_ble_work_display(const uint8_t *arg)
+{
+	if (epd_update_state)
+		return 0;
+	EPD_Display(epd_buffer, epd_buffer_red, epd_get_plane_size(), arg[0]);
+	epd_upload_active = 0;
+	return 1;
+}
+
+_attribute_ram_code_ static uint8_t epd_ble_work_tiff(const uint8_t *arg)
+{
+	if (epd_update_state)
+		return 0;
+	if (arg[0])
+		epd_tiff_stream_end();
+	else
+		epd_display_tiff(epd_buffer, byte_pos);
+	epd_upload_active = 0;
+	return 1;
+}
+
+_attribute_ram_code_ static uint8_t epd_ble_work_window(const uint8_t *arg)
+{
+	struct epd_window window;
+
+	if (epd_update_state)
+		return 0;
+	memcpy(&window, arg, sizeof(window));
+	EPD_Display_window(epd_buffer, epd_buffer_red, epd_get_plane_size(), 0, &window);
+	epd_upload_active = 0;
+	return 1;
+}
+
+// Starts the held update once the panel is idle and selects the plane when
+// the controller is initialised. Replies 1, or 0 if the panel has no RAM for it.
+_attribute_ram_code_ static uint8_t epd_ble_work_direct(const uint8_t *arg)
+{
+	uint8_t out_buffer[2] = {0};
+
+	if (!epd_direct_active())
+	{
+		if (epd_update_state)
+			return 0;
+		if (!epd_direct_begin())
+		{
+			bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+			epd_upload_active = 0;
+			return 1;
+		}
+	}
+	if (!epd_direct_ready())
+		return 0;
+	out_buffer[1] = epd_direct_plane(arg[0] != 0xff);
+	epd_direct_plane_set = out_buffer[1];
+	epd_direct_pos = 0;
+	bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+	return 1;
+}
+
+#define EPD_BULK_SEEN(seq) (epd_bulk_seen[(seq) >> 3] & (1 << ((seq) & 7)))
+
+_attribute_ram_code_ static void epd_bulk_send_ack(void)
+{
+	uint8_t out_buffer[5 + EPD_BULK_ACK_CHUNKS / 8] = {0};
+	uint16_t seq;
+
+	out_buffer[0] = 0x09;
+	out_buffer[1] = epd_bulk_base >> 8;
+	out_buffer[2] = epd_bulk_base & 0xff;
+	out_buffer[3] = epd_bulk_top >> 8;
+	out_buffer[4] = epd_bulk_top & 0xff;
+	for (seq = epd_bulk_base; seq < epd_bulk_top && seq < epd_bulk_base + EPD_BULK_ACK_CHUNKS; seq++)
+	{
+		if (!EPD_BULK_SEEN(seq))
+			out_buffer[5 + ((seq - epd_bulk_base) >> 3)] |= 1 << ((seq - epd_bulk_base) & 7);
+	}
+	epd_bulk_since_ack = 0;
+	bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, sizeof(out_buffer));
+}
+
+// Reply ff ff <cmd> to a command that can't be taken now, to be retried
+_attribute_ram_code_ static void epd_ble_send_busy(uint8_t cmd)
+{
+	uint8_t out_buffer[3] = {0xff, 0xff, cmd};
+	bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, sizeof(out_buffer));
+}
+
+// Commands that write into the image planes
+#define EPD_BLE_PLANE_WRITES (BIT(0x00) | BIT(0x03) | BIT(0x05) | BIT(0x06) | BIT(0x07) | BIT(0x08) | BIT(0x0A))
 
 int epd_ble_handle_write(void *p)
 {
@@ -27,27 +180,77 @@ int epd_ble_handle_write(void *p)
 
 	ASSERT_MIN_LEN(payload_len, 1);
 
+	if (payload[0] < 32 && (EPD_BLE_PLANE_WRITES & BIT(payload[0])))
+	{
+		// The next image is uploaded while the current one refreshes, once its
+		// planes have left the buffers. Until then main_loop is still resetting the
+		// controller and plane writes are refused with ff ff <cmd>, to be retried.
+		if (epd_planes_pending())
+		{
+			epd_ble_send_busy(payload[0]);
+			return 0;
+		}
+		if (payload[0] != 0x0A)
+		{ // the planes stop matching the panel, only a delta patches them in place
+			epd_buffer_shown = 0;
+			epd_base_release();
+		}
+	}
+
 	switch (payload[0])
 	{
-	// Clear EPD display.
+	// Clear EPD display. Replies 1, a client starts an upload with it.
 	case 0x00:
 	    ASSERT_MIN_LEN(payload_len, 2);
 		memset(epd_buffer, payload[1], epd_buffer_size);
-		memset(epd_temp, payload[1], epd_buffer_size);
+		memset(epd_buffer_red, payload[1], epd_buffer_size);
+		epd_lz_started = 0;
+		epd_tiff_started = 0;
+		epd_tiff_failed = 0;
+		epd_upload_active = 1;
 		ble_set_connection_speed(40);
+		out_buffer[1] = 1;
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
 		return 0;
 	// Push buffer to display.
 	case 0x01:
 		ble_set_connection_speed(200);
-		EPD_Display(epd_buffer, epd_temp, epd_buffer_size, payload[1]);
+		if (epd_direct_active())
+		{ // the planes are in controller RAM, only the waveform is left
+			epd_direct_show(payload[1]);
+			epd_direct_plane_set = 0;
+			epd_upload_active = 0;
+			return 0;
+		}
+		if (!work_queue_push(epd_ble_work_display, &payload[1], 1))
+		{ // the work queue is full, the planes stay for the retry
+			epd_ble_send_busy(payload[0]);
+			return 0;
+		}
+		epd_upload_active = 1; // until the planes are sent
 		return 0;
 	// Set byte_pos.
 	case 0x02:
 		ASSERT_MIN_LEN(payload_len, 3);
 		byte_pos = payload[1] << 8 | payload[2];
+		epd_lz_started = 0;
 		return 0;
 	// Write data to image buffer.
 	case 0x03:
+		if (epd_direct_plane_set)
+		{
+			if ((payload[2] << 8 | payload[3]) != epd_direct_pos || epd_direct_pos + payload_len - 4 > epd_get_plane_size())
+			{
+				bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+				return 0;
+			}
+			epd_direct_write(payload + 4, payload_len - 4);
+			epd_direct_pos += payload_len - 4;
+			out_buffer[0] = payload_len >> 8;
+			out_buffer[1] = payload_len & 0xff;
+			bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+			return 0;
+		}
 		if ((payload[2] << 8 | payload[3]) + payload_len - 4 >= epd_buffer_size + 1)
 		{
 		    out_buffer[0] = 0x00;
@@ -58,15 +261,286 @@ int epd_ble_handle_write(void *p)
 		if (payload[1] == 0xff) { // BLACK bitplan
 		    memcpy(epd_buffer + (payload[2] << 8 | payload[3]), payload + 4, payload_len - 4);
 		} else { // RED bitplan
-		    memcpy(epd_temp + (payload[2] << 8 | payload[3]), payload + 4, payload_len - 4);
+		    memcpy(epd_buffer_red + (payload[2] << 8 | payload[3]), payload + 4, payload_len - 4);
 		}
 
+		epd_upload_active = 1;
+
 		out_buffer[0] = payload_len >> 8;
 		out_buffer[1] = payload_len & 0xff;
 		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
 		return 0;
+	// Write compressed data to image buffer, decoded from byte_pos on.
+	// The reply is the decoded size so far, 0 if the stream was rejected.
+	case 0x05:
+		ASSERT_MIN_LEN(payload_len, 2);
+		if (!epd_lz_started || payload[1] != epd_lz_plane)
+		{ // first chunk of a plane
+			epd_lz_started = 1;
+			epd_lz_plane = payload[1];
+			epd_lz_start(&epd_lz, payload[1] == 0xff ? epd_buffer : epd_buffer_red, epd_buffer_size, byte_pos);
+		}
+		if (!epd_lz_feed(&epd_lz, payload + 2, payload_len - 2))
+		{
+			epd_lz_started = 0;
+			out_buffer[0] = 0x00;
+			out_buffer[1] = 0x00;
+			bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+			return 0;
+		}
+		epd_upload_active = 1;
+
+		out_buffer[0] = epd_lz.pos >> 8;
+		out_buffer[1] = epd_lz.pos & 0xff;
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
 	case 0x04: // decode & display a TIFF image
-		epd_display_tiff(epd_buffer, byte_pos);
+		{ // finish the streamed decode, or decode the whole file from the buffer
+			uint8_t streamed = epd_tiff_started;
+			if (epd_tiff_failed)
+			{
+				epd_tiff_failed = 0;
+				epd_upload_active = 0;
+				bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+				return 0;
+			}
+			if (!work_queue_push(epd_ble_work_tiff, &streamed, 1))
+			{
+				epd_ble_send_busy(payload[0]);
+				return 0;
+			}
+			epd_tiff_started = 0;
+			epd_upload_active = 1;
+		}
+		return 0;
+	// Stream G4 data into the decoder, the first chunk after 0x00 starts it.
+	// The reply is the number of lines decoded so far, 0xffff on error. If
+	// the decoder can't be opened the first chunk gets 0, the rest of the
+	// stream none and 0x04 replies 0 instead of showing it.
+	case 0x06:
+		if (epd_tiff_failed)
+			return 0;
+		if (!epd_tiff_started)
+		{
+			if (!epd_tiff_stream_start())
+			{ // rejected like a bad 0x05 chunk, the rest of the stream is ignored
+				epd_tiff_failed = 1;
+				bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+				return 0;
+			}
+			epd_tiff_started = 1;
+		}
+		epd_upload_active = 1;
+		{
+			int lines = epd_tiff_stream_feed(payload + 1, payload_len - 1);
+			out_buffer[0] = lines >> 8;
+			out_buffer[1] = lines & 0xff;
+		}
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	// Start a bulk transfer: plane, chunk size, number of chunks, ack interval
+	case 0x07:
+		ASSERT_MIN_LEN(payload_len, 6);
+		epd_bulk_chunks = 0;
+		epd_bulk_chunk_size = payload[2];
+		{
+			uint16_t chunks = payload[3] << 8 | payload[4];
+			if (!epd_bulk_chunk_size || !payload[5] || !chunks || chunks > EPD_BULK_MAX_CHUNKS
+				|| (chunks - 1) * epd_bulk_chunk_size >= epd_buffer_size)
+			{
+				out_buffer[0] = 0x00;
+				out_buffer[1] = 0x00;
+				bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+				return 0;
+			}
+			epd_bulk_chunks = chunks;
+		}
+		epd_bulk_plane = payload[1] == 0xff ? epd_buffer : epd_buffer_red;
+		epd_bulk_ack_every = payload[5];
+		epd_bulk_base = epd_bulk_top = epd_bulk_since_ack = 0;
+		memset(epd_bulk_seen, 0, sizeof(epd_bulk_seen));
+		epd_upload_active = 1;
+		epd_bulk_send_ack();
+		return 0;
+	// Bulk chunk: sequence number and data, written without response
+	case 0x08:
+		ASSERT_MIN_LEN(payload_len, 4);
+		{
+			uint16_t seq = payload[1] << 8 | payload[2];
+			unsigned int offset = seq * epd_bulk_chunk_size;
+			unsigned int len = payload_len - 3;
+			if (seq >= epd_bulk_chunks || len > epd_bulk_chunk_size)
+				return 0; // no transfer running or a stray chunk
+			if (offset + len > epd_buffer_size)
+				len = epd_buffer_size - offset;
+			if (!EPD_BULK_SEEN(seq))
+			{
+				memcpy(epd_bulk_plane + offset, payload + 3, len);
+				epd_bulk_seen[seq >> 3] |= 1 << (seq & 7);
+				if (seq >= epd_bulk_top)
+					epd_bulk_top = seq + 1;
+				while (epd_bulk_base < epd_bulk_chunks && EPD_BULK_SEEN(epd_bulk_base))
+					epd_bulk_base++;
+			}
+		}
+		if (++epd_bulk_since_ack >= epd_bulk_ack_every || epd_bulk_base == epd_bulk_chunks)
+			epd_bulk_send_ack();
+		return 0;
+	// Request an ack now, e.g. after the last chunk of a window went missing
+	case 0x09:
+		if (epd_bulk_chunks)
+			epd_bulk_send_ack();
+		return 0;
+	// Patch a plane from byte_pos on: records of skip (2 bytes), count and
+	// count bytes XORed into the plane. Replies with byte_pos, 0 if rejected.
+	case 0x0A:
+		ASSERT_MIN_LEN(payload_len, 2);
+		{
+			uint8_t *plane = payload[1] == 0xff ? epd_buffer : epd_buffer_red;
+			uint8_t stride = epd_get_plane_stride();
+			unsigned int i = 2;
+
+			if (!epd_buffer_shown)
+				epd_buffer_shown = epd_base_load(); // cleared by deep retention, read back from flash
+			if (!epd_buffer_shown)
+				payload_len = 0; // the base image is gone, a full upload is needed
+			if (!epd_delta_active)
+			{
+				epd_delta_active = 1;
+				epd_delta_first = 0xffff;
+				epd_delta_byte_first = 0xff;
+				epd_delta_last = epd_delta_byte_last = 0;
+			}
+			while (i + 3 <= payload_len)
+			{
+				unsigned int count = payload[i + 2];
+				byte_pos += payload[i] << 8 | payload[i + 1];
+				i += 3;
+				if (i + count > payload_len || byte_pos + count > epd_buffer_size)
+				{
+					payload_len = 0;
+					break;
+				}
+				for (; count; count--, byte_pos++)
+				{
+					uint8_t x = payload[i++];
+					if (!x)
+						continue;
+					plane[byte_pos] ^= x;
+					if (byte_pos / stride < epd_delta_first)
+						epd_delta_first = byte_pos / stride;
+					if (byte_pos / stride > epd_delta_last)
+						epd_delta_last = byte_pos / stride;
+					if (byte_pos % stride < epd_delta_byte_first)
+						epd_delta_byte_first = byte_pos % stride;
+					if (byte_pos % stride > epd_delta_byte_last)
+						epd_delta_byte_last = byte_pos % stride;
+				}
+			}
+			if (!payload_len || i != payload_len)
+			{ // rejected, the planes no longer match the panel
+				epd_buffer_shown = 0;
+				epd_base_release();
+				epd_delta_active = 0;
+				out_buffer[0] = 0x00;
+				out_buffer[1] = 0x00;
+				bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+				return 0;
+			}
+		}
+		epd_upload_active = 1;
+		out_buffer[0] = byte_pos >> 8;
+		out_buffer[1] = byte_pos & 0xff;
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	// Show the patched planes, refreshing only the changed area
+	case 0x0B:
+		if (epd_delta_active && epd_buffer_shown && epd_delta_first <= epd_delta_last)
+		{
+			struct epd_window window;
+			window.stride = epd_get_plane_stride();
+			window.row = epd_delta_first;
+			window.rows = epd_delta_last - epd_delta_first + 1;
+			window.byte = epd_delta_byte_first;
+			window.bytes = epd_delta_byte_last - epd_delta_byte_first + 1;
+			ble_set_connection_speed(200);
+			if (!work_queue_push(epd_ble_work_window, &window, sizeof(window)))
+			{ // the patched planes stay for the retry
+				epd_ble_send_busy(payload[0]);
+				return 0;
+			}
+			epd_delta_active = 0;
+			return 0;
+		}
+		epd_delta_active = 0;
+		epd_upload_active = 0;
+		return 0;
+	// Store an image in a flash slot: 0x0C <slot> erases it, 0x0D <plane> <data>
+	// appends compressed plane data (black first) and 0x0E makes it valid.
+	// 0x0C/0x0E reply 1, 0x0D the bytes stored, all of them 0 on error.
+	case 0x0C:
+		ASSERT_MIN_LEN(payload_len, 2);
+		out_buffer[1] = epd_slot_begin(payload[1]);
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	case 0x0D:
+		ASSERT_MIN_LEN(payload_len, 3);
+		{
+			int stored = epd_slot_write(payload[1], payload + 2, payload_len - 2);
+			out_buffer[0] = stored >> 8;
+			out_buffer[1] = stored & 0xff;
+		}
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	case 0x0E:
+		out_buffer[1] = epd_slot_end();
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	// BWR296 full refresh waveforms per temperature: 0x10 erases the table,
+	// 0x11 <bin> <max °C> <159 bytes> stores a bin and 0x12 makes the table
+	// valid, all reply 1 or 0. 0x13 replies the last refresh time in ms of
+	// each bin and of the OTP waveform, uint16 big-endian.
+	case 0x10:
+		EPD_BWR_296_lut_begin();
+		out_buffer[1] = 1;
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	case 0x11:
+		ASSERT_MIN_LEN(payload_len, 3);
+		out_buffer[1] = EPD_BWR_296_lut_write(payload[1], (int8_t)payload[2], payload + 3, payload_len - 3);
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	case 0x12:
+		EPD_BWR_296_lut_end();
+		out_buffer[1] = 1;
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, 2);
+		return 0;
+	case 0x13:
+		{
+			uint16_t ms[EPD_BWR_296_LUT_BINS + 1];
+			int i;
+			EPD_BWR_296_lut_times(ms);
+			for (i = 0; i <= EPD_BWR_296_LUT_BINS; i++)
+			{
+				out_buffer[i * 2] = ms[i] >> 8;
+				out_buffer[i * 2 + 1] = ms[i] & 0xff;
+			}
+		}
+		bls_att_pushNotifyData(EPD_BLE_CMD_OUT_DP_H, out_buffer, (EPD_BWR_296_LUT_BINS + 1) * 2);
+		return 0;
+	// Direct upload: 0x0F <plane> with 0xff for black, then 0x03 chunks of that
+	// plane in order from offset 0 and 0x01 to refresh. Replies 1 once the
+	// controller takes the plane, 0 if it can't (upload to the buffers instead).
+	case 0x0F:
+		ASSERT_MIN_LEN(payload_len, 2);
+		ble_set_connection_speed(40);
+		epd_direct_plane_set = 0;
+		if (!work_queue_push(epd_ble_work_direct, &payload[1], 1))
+		{
+			epd_ble_send_busy(payload[0]);
+			return 0;
+		}
+		epd_upload_active = 1;
 		return 0;
 	default:
 		return 0;
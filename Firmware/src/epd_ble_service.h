@@ -1,3 +1,6 @@
 #pragma once
+#include <stdint.h>
 
-int epd_ble_handle_write(void * p);
\ No newline at end of file
+int epd_ble_handle_write(void * p);
+uint8_t epd_ble_upload_active(void);
+void epd_ble_upload_reset(void);
\ No newline at end of file
@@ -46,65 +46,64 @@ _attribute_ram_code_ uint8_t EPD_BW_213_read_temp(void)
     return epd_temperature;
 }
 
-_attribute_ram_code_ uint8_t EPD_BW_213_Display(unsigned char *image, int size, uint8_t full_or_partial)
+_attribute_ram_code_ uint16_t EPD_BW_213_Display_step(struct epd_job *job)
 {
-    uint8_t epd_temperature = 0 ;
-    
-    // Booster soft start
-    EPD_WriteCmd(0x06);
-    EPD_WriteData(0x17);
-    EPD_WriteData(0x17);
-    EPD_WriteData(0x17);
-    // power on
-    EPD_WriteCmd(0x04);
-
-    // check BUSY pin
-    EPD_CheckStatus(100);
-
-    EPD_WriteCmd(0x40);
-    epd_temperature = EPD_SPI_read();
-    EPD_SPI_read();
-
-    // panel setting
-    EPD_WriteCmd(0x00);
-    if (full_or_partial)
-        EPD_WriteData(0b00011111);
-    else
-        EPD_WriteData(0b00111111);
-    EPD_WriteData(0x0f);
-
-    // resolution setting
-    EPD_WriteCmd(0x61);
-    EPD_WriteData(0x80);
-    EPD_WriteData(0x01);
-    EPD_WriteData(0x28);
-
-    // Vcom and data interval setting
-    EPD_WriteCmd(0X50);
-    EPD_WriteData(0x97);
-
-    if (!full_or_partial)
+    switch (job->step++)
     {
-        EPD_send_lut(lut_bw_213_20_part, sizeof(lut_bw_213_20_part));
-        EPD_send_empty_lut(0x21, 260);
-        EPD_send_lut(lut_bw_213_22_part, sizeof(lut_bw_213_22_part));
-        EPD_send_lut(lut_bw_213_23_part, sizeof(lut_bw_213_23_part));
-        EPD_send_empty_lut(0x24, 260);
-
-        EPD_WriteCmd(0x10);
-        int i;
-        for (i = 0; i < size; i++)
+    case 0:
+        // Booster soft start
+        EPD_WriteCmd(0x06);
+        EPD_WriteData(0x17);
+        EPD_WriteData(0x17);
+        EPD_WriteData(0x17);
+        // power on
+        EPD_WriteCmd(0x04);
+
+        // check BUSY pin
+        return EPD_BUSY_WAIT_MS;
+    case 1:
+        EPD_WriteCmd(0x40);
+        job->temperature = EPD_SPI_read();
+        EPD_SPI_read();
+
+        // panel setting
+        EPD_WriteCmd(0x00);
+        if (job->full_or_partial)
+            EPD_WriteData(0b00011111);
+        else
+            EPD_WriteData(0b00111111);
+        EPD_WriteData(0x0f);
+
+        // resolution setting
+        EPD_WriteCmd(0x61);
+        EPD_WriteData(0x80);
+        EPD_WriteData(0x01);
+        EPD_WriteData(0x28);
+
+        // Vcom and data interval setting
+        EPD_WriteCmd(0X50);
+        EPD_WriteData(0x97);
+
+        if (!job->full_or_partial)
         {
-            EPD_WriteData(~image[i]);
+            EPD_send_lut(lut_bw_213_20_part, sizeof(lut_bw_213_20_part));
+            EPD_send_empty_lut(0x21, 260);
+            EPD_send_lut(lut_bw_213_22_part, sizeof(lut_bw_213_22_part));
+            EPD_send_lut(lut_bw_213_23_part, sizeof(lut_bw_213_23_part));
+            EPD_send_empty_lut(0x24, 260);
+
+            EPD_LoadPlane(job, EPD_PLANE_BLACK | EPD_PLANE_INVERT, 0x10, NULL);
         }
-    }
-    // load image data to EPD
-    EPD_LoadImage(image, size, 0x13);
+        // load image data to EPD
+        EPD_LoadPlane(job, EPD_PLANE_BLACK, 0x13, NULL);
 
-    // trigger display refresh
-    EPD_WriteCmd(0x12);
+        // trigger display refresh
+        EPD_WriteCmd(0x12);
 
-    return epd_temperature;
+        return EPD_REFRESH_WAIT_MS;
+    default:
+        return 0;
+    }
 }
 
 _attribute_ram_code_ void EPD_BW_213_set_sleep(void)
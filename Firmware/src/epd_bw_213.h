@@ -1,5 +1,5 @@
 #pragma once
 
 uint8_t EPD_BW_213_read_temp(void);
-uint8_t EPD_BW_213_Display(unsigned char *image, int size, uint8_t full_or_partial);
+uint16_t EPD_BW_213_Display_step(struct epd_job *job);
 void EPD_BW_213_set_sleep(void);
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "epd.h"
 #include "epd_spi.h"
 #include "epd_bw_213_ice.h"
+#include "refresh_policy.h"
 #include "drivers.h"
 #include "stack/ble/ble.h"
 
@@ -138,93 +139,9 @@ _attribute_ram_code_ uint8_t EPD_BW_213_ice_read_temp(void)
     return epd_temperature;
 }
 
-_attribute_ram_code_ uint8_t EPD_BW_213_ice_Display(unsigned char *image, int size, uint8_t full_or_partial)
-{    
-    uint8_t epd_temperature = 0 ;
-    
-    // SW Reset
-    EPD_WriteCmd(0x12);
-
-    EPD_CheckStatus_inverted(100);
-
-    // Set Analog Block control
-    EPD_WriteCmd(0x74);
-    EPD_WriteData(0x54);
-    // Set Digital Block control
-    EPD_WriteCmd(0x7E);
-    EPD_WriteData(0x3B);
-    
-    // ACVCOM Setting
-    EPD_WriteCmd(0x2B);
-    EPD_WriteData(0x04);
-    EPD_WriteData(0x63);
-
-    // Booster soft start
-    EPD_WriteCmd(0x0C);
-    EPD_WriteData(0x8B);
-    EPD_WriteData(0x9C);
-    EPD_WriteData(0x96);
-    EPD_WriteData(0x0F);
-
-    // Driver output control
-    EPD_WriteCmd(0x01);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
-    EPD_WriteData(0x01);
-
-    // Data entry mode setting
-    EPD_WriteCmd(0x11);
-    EPD_WriteData(0x01);
-
-    // Temperature sensor control
-    EPD_WriteCmd(0x18);
-    EPD_WriteData(0x80);
-
-    // Set RAM X- Address Start/End
-    EPD_WriteCmd(0x44);
-    EPD_WriteData(0x00);
-    EPD_WriteData(0x0C);
-
-    // Set RAM Y- Address Start/End
-    EPD_WriteCmd(0x45);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
-    EPD_WriteData(0x54);
-    EPD_WriteData(0x00);
-
-    // Border waveform control
-    EPD_WriteCmd(0x3C);
-    EPD_WriteData(0x01);
-
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xA1);
-
-    // Master Activation
-    EPD_WriteCmd(0x20);
-    
-    EPD_CheckStatus_inverted(100);
-
-    // Temperature sensor read from register
-    EPD_WriteCmd(0x1B);
-    epd_temperature = EPD_SPI_read();    
-    EPD_SPI_read();
-
-    WaitMs(5);
-
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xB1);
-    
-    // Master Activation
-    EPD_WriteCmd(0x20);
-
-    EPD_CheckStatus_inverted(100);
-    
-    // Display update control
-    EPD_WriteCmd(0x21);
-    EPD_WriteData(0x03);
-
+// Point the RAM address counters at the first byte of a plane
+_attribute_ram_code_ void EPD_BW_213_ice_set_ram_start(void)
+{
     // Set RAM X address
     EPD_WriteCmd(0x4E);
     EPD_WriteData(0x00);
@@ -233,31 +150,134 @@ _attribute_ram_code_ uint8_t EPD_BW_213_ice_Display(unsigned char *image, int si
     EPD_WriteCmd(0x4F);
     EPD_WriteData(0x28);
     EPD_WriteData(0x01);
+}
 
-    EPD_LoadImage(image, size, 0x24);
-
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0x40);
-
-    int i;
-    if (!full_or_partial)
+_attribute_ram_code_ uint16_t EPD_BW_213_ice_Display_step(struct epd_job *job)
+{
+    switch (job->step++)
     {
-        EPD_WriteCmd(0x32);
-        for (i = 0; i < sizeof(LUT_BW_213_ice_part); i++)
+    case 0:
+        // SW Reset
+        EPD_WriteCmd(0x12);
+
+        return EPD_BUSY_WAIT_MS;
+    case 1:
+        // Set Analog Block control
+        EPD_WriteCmd(0x74);
+        EPD_WriteData(0x54);
+        // Set Digital Block control
+        EPD_WriteCmd(0x7E);
+        EPD_WriteData(0x3B);
+
+        // ACVCOM Setting
+        EPD_WriteCmd(0x2B);
+        EPD_WriteData(0x04);
+        EPD_WriteData(0x63);
+
+        // Booster soft start
+        EPD_WriteCmd(0x0C);
+        EPD_WriteData(0x8B);
+        EPD_WriteData(0x9C);
+        EPD_WriteData(0x96);
+        EPD_WriteData(0x0F);
+
+        // Driver output control
+        EPD_WriteCmd(0x01);
+        EPD_WriteData(0x28);
+        EPD_WriteData(0x01);
+        EPD_WriteData(0x01);
+
+        // Data entry mode setting
+        EPD_WriteCmd(0x11);
+        EPD_WriteData(0x01);
+
+        // Temperature sensor control
+        EPD_WriteCmd(0x18);
+        EPD_WriteData(0x80);
+
+        // Set RAM X- Address Start/End
+        EPD_WriteCmd(0x44);
+        EPD_WriteData(0x00);
+        EPD_WriteData(0x0C);
+
+        // Set RAM Y- Address Start/End
+        EPD_WriteCmd(0x45);
+        EPD_WriteData(0x28);
+        EPD_WriteData(0x01);
+        EPD_WriteData(0x54);
+        EPD_WriteData(0x00);
+
+        // Border waveform control
+        EPD_WriteCmd(0x3C);
+        EPD_WriteData(0x01);
+
+        // Display update control
+        EPD_WriteCmd(0x22);
+        EPD_WriteData(0xA1);
+
+        // Master Activation
+        EPD_WriteCmd(0x20);
+
+        return EPD_BUSY_WAIT_MS;
+    case 2:
+        // Temperature sensor read from register
+        EPD_WriteCmd(0x1B);
+        job->temperature = EPD_SPI_read();
+        EPD_SPI_read();
+
+        WaitMs(5);
+
+        // Display update control
+        EPD_WriteCmd(0x22);
+        EPD_WriteData(0xB1);
+
+        // Master Activation
+        EPD_WriteCmd(0x20);
+
+        return EPD_BUSY_WAIT_MS;
+    case 3:
+        // Display update control
+        EPD_WriteCmd(0x21);
+        EPD_WriteData(0x03);
+
+        EPD_BW_213_ice_set_ram_start();
+        EPD_LoadPlane(job, EPD_PLANE_BLACK, 0x24, NULL);
+
+        // Display update control
+        EPD_WriteCmd(0x22);
+        EPD_WriteData(0x40);
+
+        if (!job->full_or_partial)
         {
-            EPD_WriteData(LUT_BW_213_ice_part[i]);
+            EPD_WriteCmd(0x32);
+            EPD_WriteDataBlock(LUT_BW_213_ice_part, sizeof(LUT_BW_213_ice_part));
         }
-    }      
 
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xC7);
-    
-    // Master Activation
-    EPD_WriteCmd(0x20);
+        if (job->full_or_partial == EPD_REFRESH_FAST)
+        {
+            // Write temperature register: the OTP waveform for a hot panel is the short one
+            EPD_WriteCmd(0x1A);
+            EPD_WriteData(0x5A);
+            EPD_WriteData(0x00);
+
+            // Display update control: load the waveform for that temperature and display
+            EPD_WriteCmd(0x22);
+            EPD_WriteData(0xD7);
+        }
+        else
+        {
+            // Display update control
+            EPD_WriteCmd(0x22);
+            EPD_WriteData(0xC7);
+        }
 
-    return epd_temperature;
+        // Master Activation
+        EPD_WriteCmd(0x20);
+
+        return EPD_REFRESH_WAIT_MS;
+    default:
+        return 0;
+    }
 }
 
 _attribute_ram_code_ void EPD_BW_213_ice_set_sleep(void)
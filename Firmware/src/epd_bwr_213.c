@@ -55,12 +55,9 @@ _attribute_ram_code_ uint8_t EPD_BWR_213_detect(void)
     WaitMs(10);
 
     EPD_WriteCmd(0x32);
-    int i;
-    for (i = 0; i < 153; i++) // This model has a 159 bytes LUT storage so we test for that
-    {
-        EPD_WriteData(EPD_BWR_213_test_pattern);
-    }
+    EPD_WriteDataFill(EPD_BWR_213_test_pattern, 153); // This model has a 159 bytes LUT storage so we test for that
     EPD_WriteCmd(0x33);
+    int i;
     for (i = 0; i < 153; i++)
     {
         if (EPD_SPI_read() != EPD_BWR_213_test_pattern)
@@ -130,10 +127,7 @@ void EPD_BWR_213_Display_byte(uint8_t data)
 }
 void EPD_BWR_213_Display_buffer(unsigned char *image, int size)
 {
-    for (int i = 0; i < size; i++)
-    {
-        EPD_WriteData(image[i]);
-    }
+    EPD_WriteDataBlock(image, size);
 }
 
 void EPD_BWR_213_Display_color_change()
@@ -178,11 +172,7 @@ _attribute_ram_code_ uint8_t EPD_BWR_213_Display(unsigned char *image, int size,
     WaitMs(5);
     //////////////////////// This parts clears the full screen
     EPD_WriteCmd(0x10);
-    int i;
-    for (i = 0; i < 8832; i++)
-    {
-        EPD_WriteData(0);
-    }
+    EPD_WriteDataFill(0, 8832);
 
     set_led_color(1);
     WaitMs(5);
@@ -194,10 +184,7 @@ _attribute_ram_code_ uint8_t EPD_BWR_213_Display(unsigned char *image, int size,
     WaitMs(5);
 
     EPD_WriteCmd(0x13); // Display_color_change()
-    for (i = 0; i < 8832; i++)
-    {
-        EPD_WriteData(0);
-    }
+    EPD_WriteDataFill(0, 8832);
 
     set_led_color(3);
     WaitMs(5);
@@ -211,10 +198,7 @@ _attribute_ram_code_ uint8_t EPD_BWR_213_Display(unsigned char *image, int size,
     EPD_WriteCmd(0x10); // BLACK Color
 
     int redpos = size / 2;
-    for (int i = 0; i < size; i++)
-    {
-        EPD_WriteData(image[i]);
-    }
+    EPD_WriteDataBlock(image, size);
 
     /*EPD_WriteCmd(0x13);// RED Color
     for (i = 0; i < redpos; i++)
@@ -238,83 +222,72 @@ _attribute_ram_code_ uint8_t EPD_BWR_213_Display(unsigned char *image, int size,
     return epd_temperature;
 }
 
-_attribute_ram_code_ uint8_t EPD_BWR_213_Display_BWR(unsigned char *image, unsigned char *redimage, int size, uint8_t full_or_partial)
+_attribute_ram_code_ uint16_t EPD_BWR_213_Display_BWR_step(struct epd_job *job)
 {
-    uint8_t epd_temperature = 0;
-
-    // power on
-    EPD_WriteCmd(0x04);
-    WaitMs(1);
+    switch (job->step++)
+    {
+    case 0:
+        // power on
+        EPD_WriteCmd(0x04);
+        WaitMs(1);
 
-    EPD_WriteCmd(0x00);
-    EPD_WriteData(scan_direction); //| LUT_REG);
-    EPD_WriteData(0x0f);
+        EPD_WriteCmd(0x00);
+        EPD_WriteData(scan_direction); //| LUT_REG);
+        EPD_WriteData(0x0f);
 
-    // Power on analog (same command used elsewhere before reading temp)
-    EPD_WriteCmd(0x04);
-    // Wait until controller not busy (mirrors BW 2.13 implementation)
-    EPD_CheckStatus(100);
-
-    EPD_WriteCmd(0x40);
-    epd_temperature = EPD_SPI_read();
-    EPD_SPI_read(); // discard second byte
+        // Power on analog (same command used elsewhere before reading temp)
+        EPD_WriteCmd(0x04);
+        // Wait until controller not busy (mirrors BW 2.13 implementation)
+        return EPD_BUSY_WAIT_MS;
+    case 1:
+        EPD_WriteCmd(0x40);
+        job->temperature = EPD_SPI_read();
+        EPD_SPI_read(); // discard second byte
 
-    /*EPD_send_lut(lut_bwr_213_20_part, sizeof(lut_bwr_213_20_part));
-    EPD_send_empty_lut(0x21, 260);
-    EPD_send_lut(lut_bwr_213_22_part, sizeof(lut_bwr_213_22_part));
-    EPD_send_lut(lut_bwr_213_23_part, sizeof(lut_bwr_213_23_part));
-    EPD_send_empty_lut(0x24, 260);*/
+        /*EPD_send_lut(lut_bwr_213_20_part, sizeof(lut_bwr_213_20_part));
+        EPD_send_empty_lut(0x21, 260);
+        EPD_send_lut(lut_bwr_213_22_part, sizeof(lut_bwr_213_22_part));
+        EPD_send_lut(lut_bwr_213_23_part, sizeof(lut_bwr_213_23_part));
+        EPD_send_empty_lut(0x24, 260);*/
 
-    //////////////////////// This parts clears the full screen
-    set_led_color(1);
+        //////////////////////// This parts clears the full screen
+        set_led_color(1);
 
-    EPD_WriteCmd(0x10);
-    int i;
-    for (i = 0; i < 4000; i++)
-    {
-        EPD_WriteData(0);
-    }
+        EPD_WriteCmd(0x10);
+        EPD_WriteDataFill(0, 4000);
 
-    EPD_WriteCmd(0x13); // Display_color_change()
-    for (i = 0; i < 4000; i++)
-    {
-        EPD_WriteData(0);
-    }
+        EPD_WriteCmd(0x13); // Display_color_change()
+        EPD_WriteDataFill(0, 4000);
 
-    WaitMs(5);
+        WaitMs(5);
 
-    set_led_color(4);
+        set_led_color(4);
 
-    if (image != NULL)
-    {
-        EPD_WriteCmd(0x10); // BLACK Color start Data
-        for (int i = 0; i < size; i++)
+        if (EPD_HasPlane(job, EPD_PLANE_BLACK))
         {
-            EPD_WriteData(image[i]);
+            EPD_LoadPlane(job, EPD_PLANE_BLACK, 0x10, NULL); // BLACK Color start Data
         }
-    }
-    if (redimage != NULL)
-    {
-        EPD_WriteCmd(0x13); // RED Color start Data
-        for (int i = 0; i < size; i++)
+        if (EPD_HasPlane(job, EPD_PLANE_RED))
         {
-            EPD_WriteData(redimage[i]);
+            EPD_LoadPlane(job, EPD_PLANE_RED, 0x13, NULL); // RED Color start Data
         }
-    }
-    /*if (!full_or_partial)
-    {
-        EPD_WriteCmd(0x32);
-        for (i = 0; i < sizeof(LUT_bwr_213_part); i++)
+        /*if (!full_or_partial)
         {
-            EPD_WriteData(LUT_bwr_213_part[i]);
+            EPD_WriteCmd(0x32);
+            for (i = 0; i < sizeof(LUT_bwr_213_part); i++)
+            {
+                EPD_WriteData(LUT_bwr_213_part[i]);
+            }
         }
+        */
+        //  trigger display refresh
+        set_led_color(1);
+        EPD_WriteCmd(0x12);
+
+        return EPD_REFRESH_WAIT_MS;
+    default:
+        return 0;
     }
-    */
-    //  trigger display refresh
-    set_led_color(1);
-    EPD_WriteCmd(0x12);
-
-    return epd_temperature;
 }
 
 _attribute_ram_code_ void EPD_BWR_213_set_sleep(void)
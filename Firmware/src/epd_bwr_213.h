@@ -10,5 +10,5 @@ void EPD_BWR_213_Display_end();
 void EPD_BWR_213_Display_color_change();
 
 uint8_t EPD_BWR_213_Display(unsigned char *image, int size, uint8_t full_or_partial);
-uint8_t EPD_BWR_213_Display_BWR(unsigned char *image, unsigned char *redimage, int size, uint8_t full_or_partial);
+uint16_t EPD_BWR_213_Display_BWR_step(struct epd_job *job);
 void EPD_BWR_213_set_sleep(void);
\ No newline at end of file
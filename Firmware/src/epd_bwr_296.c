@@ -1,5 +1,6 @@
 #include <stdint.h>
 #include "tl_common.h"
+#include "drivers/8258/flash.h"
 #include "main.h"
 #include "epd.h"
 #include "epd_spi.h"
@@ -35,6 +36,111 @@ BWR_296_Len, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
 
 };
 
+// Full refresh waveforms per temperature bin, in their own flash sector above
+// the schedule. Page 0 holds the magic once the table is complete, page 1 + n
+// bin n. A refresh uses the bin with the lowest max_temp at or above the panel
+// temperature, the OTP waveform if there is none. The last refresh time of
+// each bin is kept to tune them, see EPD_BWR_296_lut_times().
+#define EPD_BWR_296_LUT_FLASH 0x71000
+#define EPD_BWR_296_LUT_MAGIC 0x4C555442
+#define EPD_BWR_296_LUT_USED 0xA5
+
+struct epd_bwr_296_lut
+{
+    uint8_t used;
+    int8_t max_temp; // °C
+    uint8_t wave[EPD_BWR_296_WAVE_LEN];
+};
+
+#define EPD_BWR_296_LUT_ADDR(bin) (EPD_BWR_296_LUT_FLASH + 0x100 + (uint32_t)(bin) * 0x100)
+
+RAM uint8_t EPD_BWR_296_lut_bin = EPD_BWR_296_LUT_OTP; // of the running refresh
+RAM uint16_t EPD_BWR_296_lut_ms[EPD_BWR_296_LUT_BINS + 1];
+
+// Erase the table and start writing it
+void EPD_BWR_296_lut_begin(void)
+{
+    flash_erase_sector(EPD_BWR_296_LUT_FLASH);
+}
+
+// Store a bin: max_temp and the 153 LUT bytes for 0x32 followed by EOPT (0x3F),
+// VGH (0x03), VSH1, VSH2, VSL (0x04) and VCOM (0x2C). Returns 0 for a bad bin.
+uint8_t EPD_BWR_296_lut_write(uint8_t bin, int8_t max_temp, const uint8_t *wave, int len)
+{
+    struct epd_bwr_296_lut lut;
+
+    if (bin >= EPD_BWR_296_LUT_BINS || len != EPD_BWR_296_WAVE_LEN)
+        return 0;
+    lut.used = EPD_BWR_296_LUT_USED;
+    lut.max_temp = max_temp;
+    memcpy(lut.wave, wave, EPD_BWR_296_WAVE_LEN);
+    flash_write_page(EPD_BWR_296_LUT_ADDR(bin), sizeof(lut), (uint8_t *)&lut);
+    return 1;
+}
+
+// Make the table valid
+void EPD_BWR_296_lut_end(void)
+{
+    uint32_t magic = EPD_BWR_296_LUT_MAGIC;
+
+    flash_write_page(EPD_BWR_296_LUT_FLASH, sizeof(magic), (uint8_t *)&magic);
+}
+
+// Last full refresh time in ms of each bin, then of the OTP waveform, 0 if not used yet
+void EPD_BWR_296_lut_times(uint16_t *ms)
+{
+    memcpy(ms, EPD_BWR_296_lut_ms, sizeof(EPD_BWR_296_lut_ms));
+}
+
+// Called with the time the refresh of a finished update took
+_attribute_ram_code_ void EPD_BWR_296_refresh_done(uint16_t ms)
+{
+    EPD_BWR_296_lut_ms[EPD_BWR_296_lut_bin] = ms;
+}
+
+// Send the waveform of the bin for temperature, returns 0 to keep the OTP one
+_attribute_ram_code_ static uint8_t EPD_BWR_296_load_lut(int8_t temperature)
+{
+    struct epd_bwr_296_lut lut;
+    uint32_t magic;
+    uint8_t bin, best = EPD_BWR_296_LUT_OTP;
+    int8_t best_temp = 127;
+
+    flash_read_page(EPD_BWR_296_LUT_FLASH, sizeof(magic), (uint8_t *)&magic);
+    if (magic != EPD_BWR_296_LUT_MAGIC)
+        return 0;
+    for (bin = 0; bin < EPD_BWR_296_LUT_BINS; bin++)
+    {
+        flash_read_page(EPD_BWR_296_LUT_ADDR(bin), 2, (uint8_t *)&lut);
+        if (lut.used == EPD_BWR_296_LUT_USED && lut.max_temp >= temperature && (best == EPD_BWR_296_LUT_OTP || lut.max_temp < best_temp))
+        {
+            best = bin;
+            best_temp = lut.max_temp;
+        }
+    }
+    if (best == EPD_BWR_296_LUT_OTP)
+        return 0;
+    flash_read_page(EPD_BWR_296_LUT_ADDR(best), sizeof(lut), (uint8_t *)&lut);
+
+    EPD_WriteCmd(0x32);
+    EPD_WriteDataBlock(lut.wave, 153);
+    // Option for LUT end
+    EPD_WriteCmd(0x3F);
+    EPD_WriteData(lut.wave[153]);
+    // Gate driving voltage
+    EPD_WriteCmd(0x03);
+    EPD_WriteData(lut.wave[154]);
+    // Source driving voltage
+    EPD_WriteCmd(0x04);
+    EPD_WriteDataBlock(&lut.wave[155], 3);
+    // VCOM
+    EPD_WriteCmd(0x2C);
+    EPD_WriteData(lut.wave[158]);
+
+    EPD_BWR_296_lut_bin = best;
+    return 1;
+}
+
 #define EPD_BWR_296_test_pattern 0xA5
 _attribute_ram_code_ uint8_t EPD_BWR_296_detect(void)
 {
@@ -43,12 +149,9 @@ _attribute_ram_code_ uint8_t EPD_BWR_296_detect(void)
     WaitMs(10);
 
     EPD_WriteCmd(0x32);
-    int i;
-    for (i = 0; i < 153; i++)  // FIXME  DETECT MODEL 296
-    {
-        EPD_WriteData(EPD_BWR_296_test_pattern);
-    }
+    EPD_WriteDataFill(EPD_BWR_296_test_pattern, 153); // FIXME  DETECT MODEL 296
     EPD_WriteCmd(0x33);
+    int i;
     for (i = 0; i < 153; i++)
     {
         if(EPD_SPI_read() != EPD_BWR_296_test_pattern)
@@ -138,242 +241,175 @@ _attribute_ram_code_ uint8_t EPD_BWR_296_read_temp(void)
     return epd_temperature;
 }
 
-_attribute_ram_code_ uint8_t EPD_BWR_296_Display(unsigned char *image, int size, uint8_t full_or_partial) {
-    uint8_t epd_temperature = 0 ;
-
-    // SW Reset
-    EPD_WriteCmd(0x12);
-
-    EPD_CheckStatus_inverted(100);
-
-    // Set Analog Block control
-    EPD_WriteCmd(0x74);
-    EPD_WriteData(0x54);
-    // Set Digital Block control
-    EPD_WriteCmd(0x7E);
-    EPD_WriteData(0x3B);
-
-    // Booster soft start
-    EPD_WriteCmd(0x0C);
-    EPD_WriteData(0x8B);
-    EPD_WriteData(0x9C);
-    EPD_WriteData(0x96);
-    EPD_WriteData(0x0F);
+// Point the RAM address counters at the first byte of a plane
+_attribute_ram_code_ void EPD_BWR_296_set_ram_start(void)
+{
+    // Set RAM X address
+    EPD_WriteCmd(0x4E);
+    EPD_WriteData(0x00);
 
-    // Driver output control
-    EPD_WriteCmd(0x01);
+    // Set RAM Y address
+    EPD_WriteCmd(0x4F);
     EPD_WriteData(0x28);
     EPD_WriteData(0x01);
-    EPD_WriteData(0x01);
+}
 
-    // Data entry mode setting
-    EPD_WriteCmd(0x11);
-    EPD_WriteData(0x01);
+_attribute_ram_code_ static void EPD_BWR_296_load_full(struct epd_job *job)
+{
+    EPD_BWR_296_set_ram_start();
+    EPD_LoadPlane(job, EPD_PLANE_BLACK, 0x24, NULL);
+
+    EPD_BWR_296_set_ram_start();
+    EPD_LoadPlane(job, EPD_PLANE_RED, 0x26, NULL);
+}
+
+// Only the rows and bytes of job->window are sent, the rest of the
+// controller RAM keeps the previous frame
+_attribute_ram_code_ static void EPD_BWR_296_load_window(struct epd_job *job)
+{
+    struct epd_window *w = &job->window;
+    uint16_t y_start = 0x128 - w->row; // data entry mode 0x01 counts Y down
+    uint16_t y_end = y_start - (w->rows - 1);
 
     // Set RAM X- Address Start/End
     EPD_WriteCmd(0x44);
-    EPD_WriteData(0x00);
-    EPD_WriteData(0x0F);
+    EPD_WriteData(w->byte);
+    EPD_WriteData(w->byte + w->bytes - 1);
 
     // Set RAM Y- Address Start/End
     EPD_WriteCmd(0x45);
-    EPD_WriteData(0x28);   //0x0127-->(295+1)=296
-	EPD_WriteData(0x01);
-	EPD_WriteData(0x00);
-	EPD_WriteData(0x00);
-
-    // Border waveform control
-    EPD_WriteCmd(0x3C);
-    EPD_WriteData(0x05);
-
-    // Display update control
-    EPD_WriteCmd(0x21);
-    EPD_WriteData(0x00);
-    EPD_WriteData(0x80);
-
-    // Temperature sensor control
-    EPD_WriteCmd(0x18);
-    EPD_WriteData(0x80);
-
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xB1);
-
-    // Master Activation
-    EPD_WriteCmd(0x20);
-
-    EPD_CheckStatus_inverted(100);
-
-    // Temperature sensor read from register
-    EPD_WriteCmd(0x1B);
-    epd_temperature = EPD_SPI_read();
-    EPD_SPI_read();
-
-    WaitMs(5);
+    EPD_WriteData(y_start & 0xff);
+    EPD_WriteData(y_start >> 8);
+    EPD_WriteData(y_end & 0xff);
+    EPD_WriteData(y_end >> 8);
 
     // Set RAM X address
     EPD_WriteCmd(0x4E);
-    EPD_WriteData(0x00);
+    EPD_WriteData(w->byte);
 
     // Set RAM Y address
     EPD_WriteCmd(0x4F);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
+    EPD_WriteData(y_start & 0xff);
+    EPD_WriteData(y_start >> 8);
 
-    EPD_LoadImage(image, size, 0x24);
+    EPD_LoadPlane(job, EPD_PLANE_BLACK, 0x24, w);
 
     // Set RAM X address
     EPD_WriteCmd(0x4E);
-    EPD_WriteData(0x00);
+    EPD_WriteData(w->byte);
 
     // Set RAM Y address
     EPD_WriteCmd(0x4F);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
-
-    EPD_WriteCmd(0x26);
-    int i;
-    for (i = 0; i < size; i++)
-    {
-        EPD_WriteData(0x00);
-    }
-
-    if (!full_or_partial)
-    {
-        EPD_WriteCmd(0x32);
-        for (i = 0; i < sizeof(LUT_bwr_296_part); i++)
-        {
-            EPD_WriteData(LUT_bwr_296_part[i]);
-        }
-    }
+    EPD_WriteData(y_start & 0xff);
+    EPD_WriteData(y_start >> 8);
 
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xC7);
-
-    // Master Activation
-    EPD_WriteCmd(0x20);
-
-    return epd_temperature;
+    EPD_LoadPlane(job, EPD_PLANE_RED, 0x26, w);
 }
 
-_attribute_ram_code_ uint8_t EPD_BWR_296_Display_BWR(unsigned char *image, unsigned char *red_image, int size, uint8_t full_or_partial) {
-    if (red_image == NULL) {
-        return EPD_BWR_296_Display(image, size, full_or_partial);
-    }
-
-    uint8_t epd_temperature = 0 ;
-
-    // SW Reset
-    EPD_WriteCmd(0x12);
-
-    EPD_CheckStatus_inverted(100);
-
-    // Set Analog Block control
-    EPD_WriteCmd(0x74);
-    EPD_WriteData(0x54);
-    // Set Digital Block control
-    EPD_WriteCmd(0x7E);
-    EPD_WriteData(0x3B);
-
-    // Booster soft start
-    EPD_WriteCmd(0x0C);
-    EPD_WriteData(0x8B);
-    EPD_WriteData(0x9C);
-    EPD_WriteData(0x96);
-    EPD_WriteData(0x0F);
-
-    // Driver output control
-    EPD_WriteCmd(0x01);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
-    EPD_WriteData(0x01);
-
-    // Data entry mode setting
-    EPD_WriteCmd(0x11);
-    EPD_WriteData(0x01);
-
-    // Set RAM X- Address Start/End
-    EPD_WriteCmd(0x44);
-    EPD_WriteData(0x00);
-    EPD_WriteData(0x0F);
-
-    // Set RAM Y- Address Start/End
-    EPD_WriteCmd(0x45);
-    EPD_WriteData(0x28);   //0x0127-->(295+1)=296
-	EPD_WriteData(0x01);
-	EPD_WriteData(0x00);
-	EPD_WriteData(0x00);
-
-    // Border waveform control
-    EPD_WriteCmd(0x3C);
-    EPD_WriteData(0x05);
-
-    // Display update control
-    EPD_WriteCmd(0x21);
-    EPD_WriteData(0x00);
-    EPD_WriteData(0x80);
-
-    // Temperature sensor control
-    EPD_WriteCmd(0x18);
-    EPD_WriteData(0x80);
-
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xB1);
-
-    // Master Activation
-    EPD_WriteCmd(0x20);
+_attribute_ram_code_ uint16_t EPD_BWR_296_Display_step(struct epd_job *job)
+{
+    switch (job->step++)
+    {
+    case 0:
+        // SW Reset
+        EPD_WriteCmd(0x12);
+
+        return EPD_BUSY_WAIT_MS;
+    case 1:
+        // Set Analog Block control
+        EPD_WriteCmd(0x74);
+        EPD_WriteData(0x54);
+        // Set Digital Block control
+        EPD_WriteCmd(0x7E);
+        EPD_WriteData(0x3B);
+
+        // Booster soft start
+        EPD_WriteCmd(0x0C);
+        EPD_WriteData(0x8B);
+        EPD_WriteData(0x9C);
+        EPD_WriteData(0x96);
+        EPD_WriteData(0x0F);
+
+        // Driver output control
+        EPD_WriteCmd(0x01);
+        EPD_WriteData(0x28);
+        EPD_WriteData(0x01);
+        EPD_WriteData(0x01);
+
+        // Data entry mode setting
+        EPD_WriteCmd(0x11);
+        EPD_WriteData(0x01);
+
+        // Set RAM X- Address Start/End
+        EPD_WriteCmd(0x44);
+        EPD_WriteData(0x00);
+        EPD_WriteData(0x0F);
 
-    EPD_CheckStatus_inverted(100);
+        // Set RAM Y- Address Start/End
+        EPD_WriteCmd(0x45);
+        EPD_WriteData(0x28);   //0x0127-->(295+1)=296
+        EPD_WriteData(0x01);
+        EPD_WriteData(0x00);
+        EPD_WriteData(0x00);
 
-    // Temperature sensor read from register
-    EPD_WriteCmd(0x1B);
-    epd_temperature = EPD_SPI_read();
-    EPD_SPI_read();
+        // Border waveform control
+        EPD_WriteCmd(0x3C);
+        EPD_WriteData(0x05);
 
-    WaitMs(5);
+        // Display update control
+        EPD_WriteCmd(0x21);
+        EPD_WriteData(0x00);
+        EPD_WriteData(0x80);
 
-    // Set RAM X address
-    EPD_WriteCmd(0x4E);
-    EPD_WriteData(0x00);
+        // Temperature sensor control
+        EPD_WriteCmd(0x18);
+        EPD_WriteData(0x80);
 
-    // Set RAM Y address
-    EPD_WriteCmd(0x4F);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
+        // Display update control
+        EPD_WriteCmd(0x22);
+        EPD_WriteData(0xB1);
 
-    EPD_LoadImage(image, size, 0x24);
+        // Master Activation
+        EPD_WriteCmd(0x20);
 
-    // Set RAM X address
-    EPD_WriteCmd(0x4E);
-    EPD_WriteData(0x00);
+        return EPD_BUSY_WAIT_MS;
+    case 2:
+        // Temperature sensor read from register
+        EPD_WriteCmd(0x1B);
+        job->temperature = EPD_SPI_read();
+        EPD_SPI_read();
 
-    // Set RAM Y address
-    EPD_WriteCmd(0x4F);
-    EPD_WriteData(0x28);
-    EPD_WriteData(0x01);
+        WaitMs(5);
 
-    EPD_LoadImage(red_image, size, 0x26);
+        if (job->window.rows)
+        {
+            EPD_BWR_296_load_window(job);
+        }
+        else
+        {
+            EPD_BWR_296_load_full(job);
+        }
 
-    int i;
-    if (!full_or_partial)
-    {
-        EPD_WriteCmd(0x32);
-        for (i = 0; i < sizeof(LUT_bwr_296_part); i++)
+        EPD_BWR_296_lut_bin = EPD_BWR_296_LUT_OTP;
+        if (!job->full_or_partial)
         {
-            EPD_WriteData(LUT_bwr_296_part[i]);
+            EPD_WriteCmd(0x32);
+            EPD_WriteDataBlock(LUT_bwr_296_part, sizeof(LUT_bwr_296_part));
         }
-    }
+        else
+            EPD_BWR_296_load_lut((int8_t)job->temperature);
 
-    // Display update control
-    EPD_WriteCmd(0x22);
-    EPD_WriteData(0xC7);
+        // Display update control
+        EPD_WriteCmd(0x22);
+        EPD_WriteData(0xC7);
 
-    // Master Activation
-    EPD_WriteCmd(0x20);
+        // Master Activation
+        EPD_WriteCmd(0x20);
 
-    return epd_temperature;
+        return EPD_REFRESH_WAIT_MS;
+    default:
+        return 0;
+    }
 }
 
 _attribute_ram_code_ void EPD_BWR_296_set_sleep(void)
@@ -2,6 +2,16 @@
 
 uint8_t EPD_BWR_296_detect(void);
 uint8_t EPD_BWR_296_read_temp(void);
-uint8_t EPD_BWR_296_Display(unsigned char *image, int size, uint8_t full_or_partial);
-uint8_t EPD_BWR_296_Display_BWR(unsigned char *image, unsigned char *red_image, int size, uint8_t full_or_partial);
-void EPD_BWR_296_set_sleep(void);
\ No newline at end of file
+uint16_t EPD_BWR_296_Display_step(struct epd_job *job);
+void EPD_BWR_296_set_sleep(void);
+void EPD_BWR_296_set_ram_start(void);
+
+#define EPD_BWR_296_LUT_BINS 8
+#define EPD_BWR_296_LUT_OTP EPD_BWR_296_LUT_BINS // bin index of the OTP waveform
+#define EPD_BWR_296_WAVE_LEN 159                 // LUT, EOPT, VGH, VSH1, VSH2, VSL, VCOM
+
+void EPD_BWR_296_lut_begin(void);
+uint8_t EPD_BWR_296_lut_write(uint8_t bin, int8_t max_temp, const uint8_t *wave, int len);
+void EPD_BWR_296_lut_end(void);
+void EPD_BWR_296_lut_times(uint16_t *ms);
+void EPD_BWR_296_refresh_done(uint16_t ms);
@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include "tl_common.h"
+#include "main.h"
+#include "epd_lz.h"
+
+// Small LZ77 variant for image planes. The stream is a sequence of:
+//   0x00..0x7F  literal run, (c + 1) bytes follow
+//   0x80..0xFF  match of (c & 0x7F) + EPD_LZ_MIN_MATCH bytes, copied from a
+//               big endian 16 bit distance back in the output that follows
+// Matches are read from the plane being decoded, so no extra window RAM is
+// needed and a distance of 1 is a plain run length. The decoder keeps its state
+// between calls, a packet may end anywhere in the stream.
+
+#define EPD_LZ_MIN_MATCH 4
+
+enum
+{
+    LZ_CTRL,
+    LZ_LITERAL,
+    LZ_DIST_HI,
+    LZ_DIST_LO
+};
+
+_attribute_ram_code_ void epd_lz_start(struct epd_lz *lz, uint8_t *out, int size, int pos)
+{
+    lz->out = out;
+    lz->size = size;
+    lz->pos = pos;
+    lz->state = LZ_CTRL;
+}
+
+// Returns 0 if the stream is corrupt or runs past the end of the plane
+_attribute_ram_code_ uint8_t epd_lz_feed(struct epd_lz *lz, const uint8_t *data, int len)
+{
+    uint8_t c;
+
+    while (len-- > 0)
+    {
+        c = *data++;
+        switch (lz->state)
+        {
+        case LZ_CTRL:
+            if (c & 0x80)
+            {
+                lz->count = (c & 0x7f) + EPD_LZ_MIN_MATCH;
+                lz->state = LZ_DIST_HI;
+            }
+            else
+            {
+                lz->count = c + 1;
+                lz->state = LZ_LITERAL;
+            }
+            break;
+        case LZ_LITERAL:
+            if (lz->pos >= lz->size)
+                return 0;
+            lz->out[lz->pos++] = c;
+            if (--lz->count == 0)
+                lz->state = LZ_CTRL;
+            break;
+        case LZ_DIST_HI:
+            lz->dist = c << 8;
+            lz->state = LZ_DIST_LO;
+            break;
+        case LZ_DIST_LO:
+            lz->dist |= c;
+            if (lz->dist == 0 || lz->dist > lz->pos || lz->pos + lz->count > lz->size)
+                return 0;
+            // byte by byte, the source may overlap what is being written
+            while (lz->count--)
+            {
+                lz->out[lz->pos] = lz->out[lz->pos - lz->dist];
+                lz->pos++;
+            }
+            lz->state = LZ_CTRL;
+            break;
+        }
+    }
+    return 1;
+}
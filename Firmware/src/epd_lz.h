@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+
+// Compressed image planes, see epd_lz.c for the stream format
+struct epd_lz
+{
+    uint8_t *out;
+    uint16_t pos;
+    uint16_t size;
+    uint16_t dist;
+    uint8_t state;
+    uint8_t count;
+};
+
+void epd_lz_start(struct epd_lz *lz, uint8_t *out, int size, int pos);
+uint8_t epd_lz_feed(struct epd_lz *lz, const uint8_t *data, int len);
@@ -0,0 +1,223 @@
+#include <stdint.h>
+#include "tl_common.h"
+#include "drivers/8258/flash.h"
+#include "main.h"
+#include "epd.h"
+#include "epd_lz.h"
+#include "epd_slot.h"
+
+// Image slots in the free flash above the OTA bank (0x20000-0x3FFFF) and below
+// the settings (0x78100). A slot holds both planes as epd_lz streams, black
+// first, behind a header that is written last, so an interrupted upload
+// leaves an invalid slot instead of half an image.
+
+#define EPD_SLOT_BASE 0x40000
+#define EPD_SLOT_SIZE 0x3000 // 3 sectors, both planes fit even if they don't compress
+#define EPD_SLOT_MAGIC 0x534C4F54
+#define EPD_SLOT_HEADER 16
+
+struct epd_slot_header
+{
+    uint32_t magic;
+    uint16_t black_len;
+    uint16_t red_len;
+    uint16_t plane_size;
+    uint8_t reserved[6];
+};
+
+extern uint8_t epd_buffer[epd_buffer_size];
+extern uint8_t epd_buffer_red[epd_buffer_size];
+extern uint8_t epd_buffer_shown;
+
+RAM uint8_t epd_slot_open = 0xff; // slot being written, 0xff when none
+RAM uint8_t epd_slot_plane;
+RAM uint16_t epd_slot_black_len, epd_slot_red_len;
+RAM uint8_t epd_base_source = EPD_BASE_NONE; // where the base of delta uploads is, see epd_base_shown()
+RAM uint8_t epd_base_red; // the base has a red plane, else it is all 0
+
+#define EPD_SLOT_ADDR(slot) (EPD_SLOT_BASE + (uint32_t)(slot) * EPD_SLOT_SIZE)
+
+// flash_write_page() wraps around at page ends, so split at 256 byte boundaries
+_attribute_ram_code_ static void epd_slot_flash_write(uint32_t addr, const uint8_t *data, int len)
+{
+    while (len > 0)
+    {
+        int n = 0x100 - (addr & 0xff);
+        if (n > len)
+            n = len;
+        flash_write_page(addr, n, (uint8_t *)data);
+        addr += n;
+        data += n;
+        len -= n;
+    }
+}
+
+// Erase a slot and start writing it, returns 0 for an invalid slot
+uint8_t epd_slot_begin(uint8_t slot)
+{
+    uint32_t addr;
+
+    epd_slot_open = 0xff;
+    if (slot >= EPD_SLOT_COUNT)
+        return 0;
+    if (epd_base_source == slot)
+        epd_base_source = EPD_BASE_NONE; // the panel keeps showing the old image
+    for (addr = 0; addr < EPD_SLOT_SIZE; addr += 0x1000)
+        flash_erase_sector(EPD_SLOT_ADDR(slot) + addr);
+    epd_slot_open = slot;
+    epd_slot_plane = 0xff;
+    epd_slot_black_len = epd_slot_red_len = 0;
+    return 1;
+}
+
+// Append compressed data of a plane (0xff black, else red), the black plane
+// comes first. Returns the bytes stored so far, 0 on error.
+int epd_slot_write(uint8_t plane, const uint8_t *data, int len)
+{
+    uint32_t used = EPD_SLOT_HEADER + epd_slot_black_len + epd_slot_red_len;
+
+    if (epd_slot_open == 0xff || used + len > EPD_SLOT_SIZE || (plane == 0xff && epd_slot_red_len))
+    {
+        epd_slot_open = 0xff;
+        return 0;
+    }
+    epd_slot_flash_write(EPD_SLOT_ADDR(epd_slot_open) + used, data, len);
+    if (plane == 0xff)
+        epd_slot_black_len += len;
+    else
+        epd_slot_red_len += len;
+    return used + len - EPD_SLOT_HEADER;
+}
+
+// Write the header, which makes the slot valid
+uint8_t epd_slot_end(void)
+{
+    struct epd_slot_header header;
+
+    if (epd_slot_open == 0xff || !epd_slot_black_len)
+        return 0;
+    memset(&header, 0xff, sizeof(header));
+    header.magic = EPD_SLOT_MAGIC;
+    header.black_len = epd_slot_black_len;
+    header.red_len = epd_slot_red_len;
+    header.plane_size = epd_get_plane_size();
+    epd_slot_flash_write(EPD_SLOT_ADDR(epd_slot_open), (uint8_t *)&header, sizeof(header));
+    epd_slot_open = 0xff;
+    return 1;
+}
+
+_attribute_ram_code_ static uint8_t epd_slot_decode(uint32_t addr, int len, uint8_t *plane)
+{
+    uint8_t buf[64];
+    struct epd_lz lz;
+    int n;
+
+    epd_lz_start(&lz, plane, epd_buffer_size, 0);
+    for (; len > 0; len -= n, addr += n)
+    {
+        n = len > sizeof(buf) ? sizeof(buf) : len;
+        flash_read_page(addr, n, buf);
+        if (!epd_lz_feed(&lz, buf, n))
+            return 0;
+    }
+    return 1;
+}
+
+// Decode a slot into epd_buffer and epd_buffer_red, returns 0 if the slot is
+// empty or was stored for a panel with a different plane size
+_attribute_ram_code_ uint8_t epd_slot_load(uint8_t slot)
+{
+    struct epd_slot_header header;
+    uint32_t addr;
+
+    if (slot >= EPD_SLOT_COUNT)
+        return 0;
+    addr = EPD_SLOT_ADDR(slot);
+    flash_read_page(addr, sizeof(header), (uint8_t *)&header);
+    if (header.magic != EPD_SLOT_MAGIC || header.plane_size != epd_get_plane_size()
+        || EPD_SLOT_HEADER + header.black_len + header.red_len > EPD_SLOT_SIZE)
+        return 0;
+    memset(epd_buffer, 0xff, epd_buffer_size);
+    memset(epd_buffer_red, 0x00, epd_buffer_size);
+    addr += EPD_SLOT_HEADER;
+    if (!epd_slot_decode(addr, header.black_len, epd_buffer))
+        return 0;
+    return epd_slot_decode(addr + header.black_len, header.red_len, epd_buffer_red);
+}
+
+// The base of delta uploads (0x0A), the planes of the image on the panel. They
+// are in epd_buffer until deep retention clears it, so before that they are
+// kept raw in flash above the BWR296 waveforms. An image shown from a slot is
+// only referenced. epd_base_source in retention RAM tells where the base is.
+#define EPD_BASE_ADDR 0x72000
+#define EPD_BASE_SIZE 0x3000
+#define EPD_BASE_RED (EPD_BASE_ADDR + EPD_BASE_SIZE / 2)
+
+// An update is about to show the planes of source, EPD_BASE_BUFFER for
+// epd_buffer and epd_buffer_red, the red one only if red
+_attribute_ram_code_ void epd_base_shown(uint8_t source, uint8_t red)
+{
+    epd_base_source = source;
+    epd_base_red = red;
+}
+
+// epd_buffer is about to be overwritten
+_attribute_ram_code_ void epd_base_release(void)
+{
+    if (epd_base_source == EPD_BASE_BUFFER)
+        epd_base_source = EPD_BASE_NONE;
+}
+
+_attribute_ram_code_ static uint8_t epd_base_stored(uint32_t addr, const uint8_t *plane, int size)
+{
+    uint8_t buf[64];
+    int n;
+
+    for (; size > 0; size -= n, addr += n, plane += n)
+    {
+        n = size > sizeof(buf) ? sizeof(buf) : size;
+        flash_read_page(addr, n, buf);
+        if (memcmp(buf, plane, n))
+            return 0;
+    }
+    return 1;
+}
+
+// Called before deep retention, copies a base still only in epd_buffer to
+// flash. The sectors are only erased if they hold different planes.
+_attribute_ram_code_ void epd_base_keep(void)
+{
+    uint32_t addr;
+    int size = epd_get_plane_size();
+
+    if (epd_base_source != EPD_BASE_BUFFER || !epd_buffer_shown)
+        return;
+    if (!epd_base_stored(EPD_BASE_ADDR, epd_buffer, size)
+        || (epd_base_red && !epd_base_stored(EPD_BASE_RED, epd_buffer_red, size)))
+    {
+        for (addr = 0; addr < EPD_BASE_SIZE; addr += 0x1000)
+            flash_erase_sector(EPD_BASE_ADDR + addr);
+        epd_slot_flash_write(EPD_BASE_ADDR, epd_buffer, size);
+        if (epd_base_red)
+            epd_slot_flash_write(EPD_BASE_RED, epd_buffer_red, size);
+    }
+    epd_base_source = EPD_BASE_FLASH;
+}
+
+// Read the base back into epd_buffer and epd_buffer_red, returns 0 if the
+// panel no longer shows it
+_attribute_ram_code_ uint8_t epd_base_load(void)
+{
+    int size = epd_get_plane_size();
+
+    if (epd_base_source < EPD_SLOT_COUNT)
+        return epd_slot_load(epd_base_source);
+    if (epd_base_source != EPD_BASE_FLASH)
+        return 0;
+    flash_read_page(EPD_BASE_ADDR, size, epd_buffer);
+    if (epd_base_red)
+        flash_read_page(EPD_BASE_RED, size, epd_buffer_red);
+    else
+        memset(epd_buffer_red, 0x00, epd_buffer_size);
+    return 1;
+}
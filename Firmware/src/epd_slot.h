@@ -0,0 +1,20 @@
+#pragma once
+#include <stdint.h>
+
+// Compressed images kept in flash, see epd_slot.c
+#define EPD_SLOT_COUNT 16
+
+uint8_t epd_slot_begin(uint8_t slot);
+int epd_slot_write(uint8_t plane, const uint8_t *data, int len);
+uint8_t epd_slot_end(void);
+uint8_t epd_slot_load(uint8_t slot);
+
+// Where the base of delta uploads is, besides a slot number
+#define EPD_BASE_NONE 0xff   // the panel shows no known planes
+#define EPD_BASE_BUFFER 0xfe // only in epd_buffer
+#define EPD_BASE_FLASH 0xfd  // copied to flash by epd_base_keep()
+
+void epd_base_shown(uint8_t source, uint8_t red);
+void epd_base_release(void);
+void epd_base_keep(void);
+uint8_t epd_base_load(void);
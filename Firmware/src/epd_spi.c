@@ -6,6 +6,9 @@
 #include "drivers.h"
 #include "stack/ble/ble.h"
 
+RAM uint32_t epd_spi_bytes_sent = 0;
+RAM uint32_t epd_spi_busy_ticks = 0;
+
 _attribute_ram_code_ void EPD_init(void)
 {
     gpio_set_func(EPD_RESET, AS_GPIO);
@@ -38,11 +41,12 @@ _attribute_ram_code_ void EPD_init(void)
     gpio_setup_up_down_resistor(EPD_ENABLE, PM_PIN_PULLUP_1M);
 }
 
-_attribute_ram_code_ void EPD_SPI_Write(unsigned char value)
+// Shift one byte out, the caller owns CS and DC
+_attribute_ram_code_ static inline void EPD_SPI_Shift(unsigned char value)
 {
     unsigned char i;
 
-    WaitUs(10);
+    epd_spi_bytes_sent++;
     for (i = 0; i < 8; i++)
     {
         gpio_write(EPD_CLK, 0);
@@ -59,6 +63,12 @@ _attribute_ram_code_ void EPD_SPI_Write(unsigned char value)
     }
 }
 
+_attribute_ram_code_ void EPD_SPI_Write(unsigned char value)
+{
+    WaitUs(10);
+    EPD_SPI_Shift(value);
+}
+
 _attribute_ram_code_ uint8_t EPD_SPI_read(void)
 {
     unsigned char i;
@@ -102,6 +112,51 @@ _attribute_ram_code_ void EPD_WriteData(unsigned char data)
     gpio_write(EPD_CS, 1);
 }
 
+// Data streams keep CS low and DC high across many bytes, so the
+// per-byte select/settle cost of EPD_WriteData is only paid once
+_attribute_ram_code_ void EPD_BeginDataStream(void)
+{
+    gpio_write(EPD_CS, 0);
+    EPD_ENABLE_WRITE_DATA();
+    WaitUs(10);
+}
+
+_attribute_ram_code_ void EPD_StreamData(unsigned char data)
+{
+    EPD_SPI_Shift(data);
+}
+
+_attribute_ram_code_ void EPD_StreamDataBlock(const unsigned char *data, int len)
+{
+    while (len-- > 0)
+        EPD_SPI_Shift(*data++);
+}
+
+_attribute_ram_code_ void EPD_StreamDataFill(unsigned char value, int len)
+{
+    while (len-- > 0)
+        EPD_SPI_Shift(value);
+}
+
+_attribute_ram_code_ void EPD_EndDataStream(void)
+{
+    gpio_write(EPD_CS, 1);
+}
+
+_attribute_ram_code_ void EPD_WriteDataBlock(const unsigned char *data, int len)
+{
+    EPD_BeginDataStream();
+    EPD_StreamDataBlock(data, len);
+    EPD_EndDataStream();
+}
+
+_attribute_ram_code_ void EPD_WriteDataFill(unsigned char value, int len)
+{
+    EPD_BeginDataStream();
+    EPD_StreamDataFill(value, len);
+    EPD_EndDataStream();
+}
+
 _attribute_ram_code_ void EPD_CheckStatus(int max_ms)
 {
     unsigned long timeout_start = clock_time();
@@ -132,26 +187,33 @@ _attribute_ram_code_ void EPD_CheckStatus_inverted(int max_ms)
 _attribute_ram_code_ void EPD_send_lut(uint8_t lut[], int len)
 {
     EPD_WriteCmd(lut[0]);
-    for (int r = 1; r <= len; r++)
-    {
-        EPD_WriteData(lut[r]);
-    }
+    EPD_WriteDataBlock(&lut[1], len);
 }
 
 _attribute_ram_code_ void EPD_send_empty_lut(uint8_t lut, int len)
 {
     EPD_WriteCmd(lut);
-    for (int r = 0; r <= len; r++)
-        EPD_WriteData(0x00);
+    EPD_WriteDataFill(0x00, len + 1);
 }
 
 _attribute_ram_code_ void EPD_LoadImage(unsigned char *image, int size, uint8_t cmd)
 {
-    int i;
+    uint32_t start = clock_time();
     EPD_WriteCmd(cmd);
-    for (i = 0; i < size; i++)
-    {
-        EPD_WriteData(image[i]);
-    }
+    EPD_WriteDataBlock(image, size);
+    epd_spi_busy_ticks += clock_time() - start;
     WaitMs(2);
+}
+
+// Bytes shifted out and CPU time spent in plane uploads, to compare upload paths
+_attribute_ram_code_ void EPD_SPI_get_stats(uint32_t *bytes_sent, uint32_t *busy_us)
+{
+    *bytes_sent = epd_spi_bytes_sent;
+    *busy_us = epd_spi_busy_ticks / CLOCK_16M_SYS_TIMER_CLK_1US;
+}
+
+_attribute_ram_code_ void EPD_SPI_reset_stats(void)
+{
+    epd_spi_bytes_sent = 0;
+    epd_spi_busy_ticks = 0;
 }
\ No newline at end of file
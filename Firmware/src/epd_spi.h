@@ -15,8 +15,17 @@ void EPD_SPI_Write(unsigned char value);
 uint8_t EPD_SPI_read(void);
 void EPD_WriteCmd(unsigned char cmd);
 void EPD_WriteData(unsigned char data);
+void EPD_BeginDataStream(void);
+void EPD_StreamData(unsigned char data);
+void EPD_StreamDataBlock(const unsigned char *data, int len);
+void EPD_StreamDataFill(unsigned char value, int len);
+void EPD_EndDataStream(void);
+void EPD_WriteDataBlock(const unsigned char *data, int len);
+void EPD_WriteDataFill(unsigned char value, int len);
 void EPD_CheckStatus(int max_ms);
 void EPD_CheckStatus_inverted(int max_ms);
 void EPD_send_lut(uint8_t lut[], int len);
 void EPD_send_empty_lut(uint8_t lut, int len);
-void EPD_LoadImage(unsigned char *image, int size, uint8_t cmd);
\ No newline at end of file
+void EPD_LoadImage(unsigned char *image, int size, uint8_t cmd);
+void EPD_SPI_get_stats(uint32_t *bytes_sent, uint32_t *busy_us);
+void EPD_SPI_reset_stats(void);
\ No newline at end of file
@@ -0,0 +1,47 @@
+#include <stdint.h>
+#include "tl_common.h"
+#include "main.h"
+#include "epd_timing.h"
+
+// Field statistics of EPD refreshes for tuning waveforms and the refresh
+// policy: per mode and phase the count, min, max and running mean in ms and a
+// histogram in powers of 4. epd.c times the phases, the table is read as is
+// over GATT and any write to it starts over.
+
+RAM struct epd_timing epd_timing;
+
+_attribute_ram_code_ void epd_timing_add(uint8_t mode, uint8_t phase, uint32_t ms)
+{
+    struct epd_timing_cell *c = &epd_timing.cell[mode][phase];
+    uint32_t x = ms >> 3;
+    uint8_t bin = 0;
+
+    if (ms > 0xffff)
+        ms = 0xffff;
+    while (x && bin < EPD_TIMING_BINS - 1)
+    {
+        x >>= 2;
+        bin++;
+    }
+    if (c->hist[bin] < 0xffff)
+        c->hist[bin]++;
+    if (c->count == 0xffff)
+        return; // the summary stays as it was
+    if (!c->count || ms < c->min_ms)
+        c->min_ms = ms;
+    if (ms > c->max_ms)
+        c->max_ms = ms;
+    c->count++;
+    c->avg_ms = ((uint32_t)c->avg_ms * (c->count - 1) + ms) / c->count;
+}
+
+void epd_timing_reset(void)
+{
+    memset(&epd_timing, 0, sizeof(epd_timing));
+}
+
+int epd_timing_write(void *p)
+{
+    epd_timing_reset();
+    return 0;
+}
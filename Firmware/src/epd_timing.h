@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+// Durations of the phases of EPD updates, see epd_timing.c. The whole table
+// is the value of the EPD timing characteristic, little-endian.
+enum
+{
+    EPD_TIMING_POWER,    // power-up, reset and controller init up to the plane load
+    EPD_TIMING_LOAD,     // sending the planes over SPI
+    EPD_TIMING_WAVEFORM, // BUSY while the waveform runs
+    EPD_TIMING_SLEEP,    // after the waveform until the panel is powered off
+    EPD_TIMING_PHASES
+};
+
+enum
+{
+    EPD_TIMING_PARTIAL,
+    EPD_TIMING_FULL,
+    EPD_TIMING_FAST, // EPD_REFRESH_FAST
+    EPD_TIMING_BWR,  // full refresh of a three colour panel
+    EPD_TIMING_MODES
+};
+
+#define EPD_TIMING_BINS 8 // < 8, 32, 128, 512, 2048, 8192, 32768 ms and above
+
+struct epd_timing_cell
+{
+    uint16_t count;
+    uint16_t min_ms;
+    uint16_t max_ms;
+    uint16_t avg_ms;
+    uint16_t hist[EPD_TIMING_BINS];
+};
+
+struct epd_timing
+{
+    struct epd_timing_cell cell[EPD_TIMING_MODES][EPD_TIMING_PHASES];
+};
+
+extern struct epd_timing epd_timing;
+
+void epd_timing_add(uint8_t mode, uint8_t phase, uint32_t ms);
+void epd_timing_reset(void);
+int epd_timing_write(void *p);
@@ -5,51 +5,116 @@
 #include "drivers/8258/flash.h"
 #include "etime.h"
 #include "main.h"
+#include "schedule.h"
+#include "flash.h"
 
-RAM uint16_t time_trime = 5000;// The higher the number the slower the time runs!, -32,768 to 32,767 
-RAM uint32_t one_second_trimmed = CLOCK_16M_SYS_TIMER_CLK_1S;
+// Time is counted on the 32k sleep timer, which keeps running in deep retention.
+// Its rate (32k ticks per second, 16 bit fraction) starts at the nominal value
+// and is corrected from the drift seen between two time syncs (0xDD).
+#define TIME_32K_HZ 32000
+#define TIME_CALIB_MIN_S (6 * 3600) // shorter sync intervals are dominated by the 1 s resolution
+#define TIME_CALIB_MAX_S (3 * 86400) // keeps the correction arithmetic in 32 bit
+#define TIME_CALIB_MAX_DRIFT 50     // 1/50 = 2%, bigger differences are time corrections, not drift
+#define TIME_CATCH_UP_MAX_S 60000   // keeps the tick arithmetic in 32 bit
+#define TIME_SCHEDULE_MAX_MIN 1440  // most minute boundaries passed at once that run the schedule
+
+RAM uint32_t time_32k_per_s = TIME_32K_HZ << 16;
+RAM uint32_t time_32k_base; // 32k tick of the last second boundary
+RAM uint16_t time_32k_frac; // and its fraction of a tick
+RAM uint32_t time_sync_unix; // time set by the last sync, 0 = not synced yet
 RAM uint32_t current_unix_time;
-RAM struct date_time current_date = {0};
+RAM int16_t time_zone_min; // minutes added to the synced time for the local time
+RAM struct date_time current_date; // date part cached for one local day
+RAM uint32_t current_date_day = 0xffffffff;
 
-RAM uint32_t last_clock_increase;
 RAM uint32_t last_reached_period[10] = {0};
 RAM uint8_t has_ever_reached[10] = {0};
 
-uint8_t map[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+extern settings_struct settings;
 
 _attribute_ram_code_ void init_time(void)
 {
-    one_second_trimmed += time_trime;
+    if (settings.time_32k_per_s)
+        time_32k_per_s = settings.time_32k_per_s;
+    time_zone_min = settings.time_zone_min;
+    time_32k_base = get_32k_tick();
+    time_32k_frac = 0;
     current_unix_time = 0;
 }
 
+// 32k ticks from the last second boundary to the boundary seconds later, frac gets the fraction
+_attribute_ram_code_ static uint32_t time_32k_ticks(uint32_t seconds, uint16_t *frac)
+{
+    uint32_t lo = seconds * (time_32k_per_s & 0xffff) + time_32k_frac;
+
+    if (frac)
+        *frac = lo & 0xffff;
+    return seconds * (time_32k_per_s >> 16) + (lo >> 16);
+}
+
+_attribute_ram_code_ static struct date_time time_local(uint32_t unix_time);
+
 _attribute_ram_code_ void handler_time(void)
 {
-    if (clock_time() - last_clock_increase >= one_second_trimmed)
+    uint32_t elapsed = get_32k_tick() - time_32k_base;
+    uint32_t seconds = elapsed / (time_32k_per_s >> 16);
+    uint32_t minute;
+
+    // catch up on all seconds that passed while sleeping at once, the estimate
+    // above ignores the fraction of the rate and can only be a little too high
+    if (seconds > TIME_CATCH_UP_MAX_S)
+        seconds = TIME_CATCH_UP_MAX_S;
+    while (seconds && time_32k_ticks(seconds, NULL) > elapsed)
+        seconds--;
+    if (!seconds)
+        return;
+
+    time_32k_base += time_32k_ticks(seconds, &time_32k_frac);
+    minute = current_unix_time - current_unix_time % 60 + 60; // first boundary to pass
+    current_unix_time += seconds;
+    if (!time_sync_unix)
+        return; // counting from 1970 since boot, the schedule would run at made up times
+
+    // every minute boundary passed gets its schedule entries, in order
+    if (minute <= current_unix_time && (current_unix_time - minute) / 60 >= TIME_SCHEDULE_MAX_MIN)
+        minute = current_unix_time - current_unix_time % 60 - (TIME_SCHEDULE_MAX_MIN - 1) * 60;
+    for (; minute <= current_unix_time; minute += 60)
     {
-        last_clock_increase += one_second_trimmed;
-        current_unix_time++;
-
-        current_date.tm_min = (current_unix_time / 60) % 60;
-        current_date.tm_hour = ((current_unix_time / 60) / 60) % 24;
-        current_date.tm_sec = current_unix_time % 60;
-
-        if (current_unix_time % 86400 == 0) {
-            current_date.tm_month = current_date.tm_month % 12;
-            if (current_date.tm_day + 1 > map[current_date.tm_month - 1]) {
-                current_date.tm_day = 1;
-                if (current_date.tm_month + 1 > 12) {
-                    current_date.tm_month = 1;
-                    current_date.tm_year += 1;
-                } else {
-                    current_date.tm_month += 1;
-                }
-            } else {
-                current_date.tm_day = current_date.tm_day + 1;
-            }
-
-            current_date.tm_week = (current_date.tm_week + 1) % 7;
-        }
+        struct date_time now = time_local(minute);
+        schedule_run(&now);
+    }
+}
+
+// Time until handler_time() rolls over to the next minute
+_attribute_ram_code_ uint32_t time_us_to_next_minute(void)
+{
+    uint32_t boundary = time_32k_ticks(60 - current_unix_time % 60, NULL);
+    uint32_t elapsed = get_32k_tick() - time_32k_base;
+
+    if (elapsed >= boundary)
+        return 0; // passed, handler_time() has not caught up yet
+    return (boundary - elapsed) * 1000 / (time_32k_per_s >> 16) * 1000;
+}
+
+// Correct the 32k rate by the difference between the device time and the
+// time received now, both counted from the previous sync
+_attribute_ram_code_ static void time_calibrate(uint32_t time_now)
+{
+    uint32_t synced_s = time_now - time_sync_unix;
+    int32_t drift_s = (int32_t)(current_unix_time - time_now);
+
+    if (!time_sync_unix || time_now <= time_sync_unix || synced_s < TIME_CALIB_MIN_S || synced_s > TIME_CALIB_MAX_S)
+        return;
+    if (drift_s * TIME_CALIB_MAX_DRIFT > (int32_t)synced_s || -drift_s * TIME_CALIB_MAX_DRIFT > (int32_t)synced_s)
+        return;
+
+    // rate * device seconds / real seconds, split to stay in 32 bit
+    time_32k_per_s += (int32_t)(time_32k_per_s / synced_s) * drift_s
+                      + (int32_t)(time_32k_per_s % synced_s) * drift_s / (int32_t)synced_s;
+    if (settings.time_32k_per_s != time_32k_per_s)
+    {
+        settings.time_32k_per_s = time_32k_per_s;
+        save_settings_to_flash();
     }
 }
 
@@ -68,15 +133,65 @@ _attribute_ram_code_ uint8_t time_reached_period(timer_channel ch, uint32_t seco
     return 0;
 }
 
-_attribute_ram_code_ void set_time(uint32_t time_now, uint16_t time_year, uint8_t time_month, uint8_t time_day, uint8_t time_week)
+// Days since 1970-01-01 to year, month and day in O(1), the civil_from_days()
+// algorithm of H. Hinnant, and the weekday 1..7 from Monday
+_attribute_ram_code_ void time_date_from_days(uint32_t days, struct date_time *date)
+{
+    uint32_t z = days + 719468; // days since 0000-03-01
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;                                   // day of the 400 year era
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365; // year of the era
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);              // day of the year from March
+    uint32_t mp = (5 * doy + 2) / 153;                                  // month from March
+    uint32_t weekday = (days + 4) % 7;                                  // 1970-01-01 was a Thursday
+
+    date->tm_day = doy - (153 * mp + 2) / 5 + 1;
+    date->tm_month = mp < 10 ? mp + 3 : mp - 9;
+    date->tm_year = yoe + era * 400 + (date->tm_month <= 2);
+    date->tm_week = weekday ? weekday : 7;
+}
+
+_attribute_ram_code_ void set_time(uint32_t time_now)
 {
+    handler_time();
+    time_calibrate(time_now);
+    time_sync_unix = time_now;
+    time_32k_base = get_32k_tick();
+    time_32k_frac = 0;
     current_unix_time = time_now;
-    current_date.tm_year = time_year;
-    current_date.tm_month = time_month;
-    current_date.tm_day = time_day;
-    current_date.tm_week = time_week;
 }
 
-_attribute_ram_code_ struct date_time get_time(void) {
+void set_time_zone(int16_t minutes)
+{
+    time_zone_min = minutes;
+    if (settings.time_zone_min != minutes)
+    {
+        settings.time_zone_min = minutes;
+        save_settings_to_flash();
+    }
+}
+
+// Local time of unix_time, the date is only recomputed when the day changed
+_attribute_ram_code_ static struct date_time time_local(uint32_t unix_time)
+{
+    uint32_t local = unix_time + time_zone_min * 60;
+    uint32_t seconds;
+
+    if (time_zone_min < 0 && unix_time < (uint32_t)(-time_zone_min * 60))
+        local = 0;
+    if (local / 86400 != current_date_day)
+    {
+        current_date_day = local / 86400;
+        time_date_from_days(current_date_day, &current_date);
+    }
+    seconds = local % 86400;
+    current_date.tm_hour = seconds / 3600;
+    current_date.tm_min = seconds / 60 % 60;
+    current_date.tm_sec = seconds % 60;
     return current_date;
-}
\ No newline at end of file
+}
+
+_attribute_ram_code_ struct date_time get_time(void)
+{
+    return time_local(current_unix_time);
+}
@@ -27,6 +27,9 @@ struct date_time
 
 void init_time(void);
 void handler_time(void);
+uint32_t time_us_to_next_minute(void);
 uint8_t time_reached_period(timer_channel ch, uint32_t seconds);
-void set_time(uint32_t time_now, uint16_t time_year, uint8_t time_month, uint8_t time_day, uint8_t time_week);
+void set_time(uint32_t time_now);
+void set_time_zone(int16_t minutes);
+void time_date_from_days(uint32_t days, struct date_time *date);
 struct date_time get_time(void);
\ No newline at end of file
@@ -7,6 +7,7 @@
 #include "drivers/8258/gpio_8258.h"
 
 #include "flash.h"
+#include "refresh_policy.h"
 
 #define MAGIC_WORD 0xABCFF123
 
@@ -37,6 +38,9 @@ void reset_settings_to_default(void)
 	settings.measure_interval = 10;
 	settings.temp_offset = 0;
 	settings.temp_alarm_point = 5;
+	settings.time_32k_per_s = 0;
+	settings.time_zone_min = 0;
+	memcpy(settings.refresh_policy, &refresh_policy_default, sizeof(settings.refresh_policy));
 }
 
 void save_settings_to_flash(void)
@@ -13,6 +13,9 @@ typedef struct Settings_struct
 	uint8_t measure_interval;//time = loop interval * factor (def: about 7 * X)
 	int8_t temp_offset;
 	uint8_t temp_alarm_point;//divide by ten for value
+	uint32_t time_32k_per_s;//learned 32k timer rate, 16 bit fraction, 0 for the nominal rate
+	int16_t time_zone_min;//minutes added to the synced time for the local time
+	uint8_t refresh_policy[5];//struct refresh_policy_cfg, thresholds of the EPD refresh policy
 	uint8_t crc;// Needs to be at the last position otherwise the settings can not be validated on next boot!!!!
 } settings_struct;
 
@@ -719,6 +719,107 @@ void obdCreateVirtualDisplay(OBDISP *pOBD, int width, int height, uint8_t *buffe
     pOBD->iScreenOffset = 0;
   }
 } /* obdCreateVirtualDisplay() */
+
+void obdCreateVirtualEPD(OBDISP *pOBD, int width, int height, uint8_t *buffer)
+{
+  obdCreateVirtualEPDBand(pOBD, width, height, buffer, 0, width);
+} /* obdCreateVirtualEPD() */
+
+void obdCreateVirtualEPDBand(OBDISP *pOBD, int width, int height, uint8_t *buffer, int iRow, int iRows)
+{
+  obdCreateVirtualDisplay(pOBD, width, height, buffer);
+  if (pOBD != NULL && buffer != NULL)
+  {
+    pOBD->type = LCD_VIRTUAL_EPD;
+    pOBD->iBandRow = iRow;
+    pOBD->iBandRows = iRows;
+    obdResetDirtyRect(pOBD);
+  }
+} /* obdCreateVirtualEPDBand() */
+
+void obdResetDirtyRect(OBDISP *pOBD)
+{
+  pOBD->iDirtyX1 = pOBD->iDirtyY1 = 0x7fff;
+  pOBD->iDirtyX2 = pOBD->iDirtyY2 = -1;
+} /* obdResetDirtyRect() */
+
+int obdGetDirtyRect(OBDISP *pOBD, int *x1, int *y1, int *x2, int *y2)
+{
+  if (pOBD->iDirtyX2 < pOBD->iDirtyX1)
+    return 0; // nothing drawn
+  *x1 = pOBD->iDirtyX1;
+  *y1 = pOBD->iDirtyY1;
+  *x2 = pOBD->iDirtyX2;
+  *y2 = pOBD->iDirtyY2;
+  return 1;
+} /* obdGetDirtyRect() */
+//
+// Grow the dirty area of an EPD layout virtual display
+//
+static void obdEPDMarkDirty(OBDISP *pOBD, int x1, int y1, int x2, int y2)
+{
+  if (x1 < pOBD->iDirtyX1) pOBD->iDirtyX1 = x1;
+  if (y1 < pOBD->iDirtyY1) pOBD->iDirtyY1 = y1;
+  if (x2 > pOBD->iDirtyX2) pOBD->iDirtyX2 = x2;
+  if (y2 > pOBD->iDirtyY2) pOBD->iDirtyY2 = y2;
+} /* obdEPDMarkDirty() */
+//
+// Set a pixel of an EPD layout virtual display
+//
+static void obdEPDSetPixel(OBDISP *pOBD, int x, int y, uint8_t ucColor)
+{
+uint8_t *d, ucMask;
+int iRow;
+
+  if (x < 0 || y < 0 || x >= pOBD->width || y >= pOBD->height)
+    return; // off the screen
+  obdEPDMarkDirty(pOBD, x, y, x, y);
+  iRow = pOBD->width - 1 - x - pOBD->iBandRow;
+  if (iRow < 0 || iRow >= pOBD->iBandRows)
+    return; // not in this band
+  d = &pOBD->ucScreen[iRow * (pOBD->height >> 3) + (y >> 3)];
+  ucMask = 0x80 >> (y & 7);
+  if (ucColor)
+    *d &= ~ucMask;
+  else
+    *d |= ucMask;
+} /* obdEPDSetPixel() */
+//
+// Draw a vertical line of an EPD layout virtual display
+// In that layout a column is contiguous, so whole bytes are written at once
+//
+static void obdEPDVLine(OBDISP *pOBD, int x, int y1, int y2, uint8_t ucColor)
+{
+uint8_t *d, ucMask;
+int iRow, iRows;
+
+  if (x < 0 || x >= pOBD->width)
+    return; // off the screen
+  if (y1 < 0) y1 = 0;
+  if (y2 >= pOBD->height) y2 = pOBD->height - 1;
+  if (y2 < y1)
+    return;
+  obdEPDMarkDirty(pOBD, x, y1, x, y2);
+  iRow = pOBD->width - 1 - x - pOBD->iBandRow;
+  if (iRow < 0 || iRow >= pOBD->iBandRows)
+    return; // not in this band
+  d = &pOBD->ucScreen[iRow * (pOBD->height >> 3) + (y1 >> 3)];
+  iRows = (y2 >> 3) - (y1 >> 3);
+  ucMask = 0xff >> (y1 & 7);
+  while (1)
+  {
+    if (iRows == 0) // last byte of the line
+      ucMask &= 0xff << (7 - (y2 & 7));
+    if (ucColor)
+      *d &= ~ucMask;
+    else
+      *d |= ucMask;
+    if (iRows-- == 0)
+      break;
+    d++;
+    ucMask = 0xff;
+  }
+} /* obdEPDVLine() */
 //
 // Scroll the internal buffer by 1 scanline (up/down)
 // width is in pixels, lines is group of 8 rows
@@ -1156,6 +1257,13 @@ int i;
 unsigned char uc, ucOld;
 int iPitch, iSize;
 
+  if (pOBD->type == LCD_VIRTUAL_EPD)
+  {
+    if (x < 0 || y < 0 || x >= pOBD->width || y >= pOBD->height)
+      return -1;
+    obdEPDSetPixel(pOBD, x, y, ucColor);
+    return 0;
+  }
   iPitch = pOBD->width;
   iSize = iPitch * (pOBD->height/8);
 
@@ -1761,11 +1869,12 @@ int i, end_y, dx, dy, tx, ty, c, iBitOff;
 uint8_t *s, *d, bits, ucMask, ucClr, uc;
 GFXfont font;
 GFXglyph glyph, *pGlyph;
-int iPitch;
+int iPitch, bEPD;
    
    if (pOBD == NULL || pFont == NULL || pOBD->ucScreen == NULL || x < 0)
       return -1;
    iPitch = pOBD->width;
+   bEPD = (pOBD->type == LCD_VIRTUAL_EPD);
    // in case of running on AVR, get copy of data from FLASH
    memcpy_P(&font, pFont, sizeof(font));
    pGlyph = &glyph;
@@ -1780,6 +1889,16 @@ int iPitch;
       memcpy_P(&glyph, &font.glyph[c], sizeof(glyph));
       dx = x + pGlyph->xOffset; // offset from character UL to start drawing
       dy = y + pGlyph->yOffset;
+      if (bEPD && (pOBD->width - 1 - dx < pOBD->iBandRow ||
+                   pOBD->width - dx - pGlyph->width >= pOBD->iBandRow + pOBD->iBandRows))
+      { // glyph is outside of this band, only account for its box
+         if (dx < pOBD->width && dy < pOBD->height)
+            obdEPDMarkDirty(pOBD, dx < 0 ? 0 : dx, dy < 0 ? 0 : dy,
+                            dx + pGlyph->width > pOBD->width ? pOBD->width - 1 : dx + pGlyph->width - 1,
+                            dy + pGlyph->height > pOBD->height ? pOBD->height - 1 : dy + pGlyph->height - 1);
+         x += pGlyph->xAdvance;
+         continue;
+      }
       s = font.bitmap + pGlyph->bitmapOffset; // start of bitmap data
       // Bitmap drawing loop. Image is MSB first and each pixel is packed next
       // to the next (continuing on to the next character line)
@@ -1817,7 +1936,9 @@ int iPitch;
                }
             } // if we ran out of bits
             if (uc & 0x80) { // set pixel
-               if (ucClr)
+               if (bEPD)
+                  obdEPDSetPixel(pOBD, dx + tx, ty, ucColor);
+               else if (ucClr)
                   d[tx] |= ucMask;
                else
                   d[tx] &= ~ucMask;
@@ -1864,6 +1985,13 @@ uint8_t y;
 uint8_t iLines;
 
   pOBD->iCursorX = pOBD->iCursorY = 0;
+  if (pOBD->type == LCD_VIRTUAL_EPD) // same pattern, converted to the EPD byte order and polarity
+  {
+     if (pOBD->ucScreen)
+        memset(pOBD->ucScreen, ~ucMirror[ucData], pOBD->iBandRows * (pOBD->height/8));
+     obdEPDMarkDirty(pOBD, 0, 0, pOBD->width - 1, pOBD->height - 1);
+     return;
+  }
   if (pOBD->type == LCD_VIRTUAL || pOBD->type >= SHARP_144x168) // pure memory, handle it differently
   {
      if (pOBD->ucScreen)
@@ -2179,6 +2307,26 @@ void obdRectangle(OBDISP *pOBD, int x1, int y1, int x2, int y2, uint8_t ucColor,
         y1 = y2;
         y2 = tmp;
     }
+    if (pOBD->type == LCD_VIRTUAL_EPD)
+    {
+        int x;
+        if (bFilled)
+        {
+            for (x = x1; x <= x2; x++)
+                obdEPDVLine(pOBD, x, y1, y2, ucColor);
+        }
+        else
+        {
+            obdEPDVLine(pOBD, x1, y1, y2, ucColor);
+            obdEPDVLine(pOBD, x2, y1, y2, ucColor);
+            for (x = x1 + 1; x < x2; x++)
+            {
+                obdEPDSetPixel(pOBD, x, y1, ucColor);
+                obdEPDSetPixel(pOBD, x, y2, ucColor);
+            }
+        }
+        return;
+    }
     if (bFilled)
     {
         int x, y, iMiddle;
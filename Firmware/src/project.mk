@@ -8,8 +8,14 @@ $(OUT_PATH)/i2c.o \
 $(OUT_PATH)/cmd_parser.o \
 $(OUT_PATH)/flash.o \
 $(OUT_PATH)/etime.o \
+$(OUT_PATH)/schedule.o \
+$(OUT_PATH)/refresh_policy.o \
+$(OUT_PATH)/work_queue.o \
 $(OUT_PATH)/epd_spi.o \
+$(OUT_PATH)/epd_lz.o \
+$(OUT_PATH)/epd_slot.o \
 $(OUT_PATH)/epd.o \
+$(OUT_PATH)/epd_timing.o \
 $(OUT_PATH)/epd_bw_213.o \
 $(OUT_PATH)/epd_bwr_296.o \
 $(OUT_PATH)/epd_bwr_213.o \
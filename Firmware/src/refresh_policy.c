@@ -0,0 +1,128 @@
+#include <stdint.h>
+#include "tl_common.h"
+#include "main.h"
+#include "flash.h"
+#include "epd.h"
+#include "refresh_policy.h"
+
+// Picks the waveform of each EPD update from how much ghosting the panel has
+// built up instead of refreshing fully once an hour. Partial refreshes are
+// counted per band of panel rows, a band past max_partials or a partial
+// window over change_pct of the panel gets a cleaning refresh. That is a fast
+// full refresh where the panel has one and it's warm enough, every
+// max_fast + 1 cleaning a real full one. Cold panels get no partial updates.
+
+extern settings_struct settings;
+extern uint8_t epd_temperature;
+
+const struct refresh_policy_cfg refresh_policy_default = {60, 3, 50, 5, 15};
+
+RAM struct refresh_policy_cfg refresh_cfg;
+RAM uint8_t refresh_partials[REFRESH_POLICY_REGIONS];
+RAM uint8_t refresh_fast_run; // fast full refreshes since the last full one
+
+void refresh_policy_init(void)
+{
+    memcpy(&refresh_cfg, settings.refresh_policy, sizeof(refresh_cfg));
+}
+
+// Set the thresholds from their bytes in struct order and keep them in flash
+void refresh_policy_set(const uint8_t *cfg)
+{
+    memcpy(&refresh_cfg, cfg, sizeof(refresh_cfg));
+    if (memcmp(settings.refresh_policy, cfg, sizeof(refresh_cfg)))
+    {
+        memcpy(settings.refresh_policy, cfg, sizeof(refresh_cfg));
+        save_settings_to_flash();
+    }
+}
+
+void refresh_policy_get(uint8_t *cfg)
+{
+    memcpy(cfg, &refresh_cfg, sizeof(refresh_cfg));
+}
+
+// Regions a window touches, all of them without one
+_attribute_ram_code_ static void refresh_policy_span(const struct epd_window *window, uint16_t width, int *first, int *last)
+{
+    *first = 0;
+    *last = REFRESH_POLICY_REGIONS - 1;
+    if (window && window->rows && width)
+    {
+        *first = window->row * REFRESH_POLICY_REGIONS / width;
+        *last = (window->row + window->rows - 1) * REFRESH_POLICY_REGIONS / width;
+        if (*last >= REFRESH_POLICY_REGIONS)
+            *last = REFRESH_POLICY_REGIONS - 1;
+    }
+}
+
+// The most partial refreshes any region has had since it was cleaned
+_attribute_ram_code_ uint8_t refresh_policy_wear(void)
+{
+    uint8_t wear = 0;
+    int i;
+
+    for (i = 0; i < REFRESH_POLICY_REGIONS; i++)
+    {
+        if (refresh_partials[i] > wear)
+            wear = refresh_partials[i];
+    }
+    return wear;
+}
+
+_attribute_ram_code_ static uint8_t refresh_policy_clean(uint8_t fast_supported)
+{
+    if (fast_supported && (int8_t)epd_temperature >= refresh_cfg.fast_min_temp && refresh_fast_run < refresh_cfg.max_fast)
+        return EPD_REFRESH_FAST;
+    return EPD_REFRESH_FULL;
+}
+
+// Waveform for an update asked for as requested, with window the area of a partial one
+_attribute_ram_code_ uint8_t refresh_policy_decide(uint8_t requested, const struct epd_window *window, uint16_t width, uint8_t fast_supported)
+{
+    int first, last, i;
+    uint8_t stride;
+
+    if (requested == EPD_REFRESH_FULL)
+        return EPD_REFRESH_FULL;
+    if (requested == EPD_REFRESH_FAST)
+        return refresh_policy_clean(fast_supported);
+
+    if ((int8_t)epd_temperature < refresh_cfg.cold_temp)
+        return refresh_policy_clean(fast_supported);
+    refresh_policy_span(window, width, &first, &last);
+    for (i = first; i <= last; i++)
+    {
+        if (refresh_partials[i] >= refresh_cfg.max_partials)
+            return refresh_policy_clean(fast_supported);
+    }
+    if (window && window->rows && width)
+    {
+        stride = window->stride ? window->stride : 1;
+        if (window->rows * window->bytes * 100 >= refresh_cfg.change_pct * width * stride)
+            return refresh_policy_clean(fast_supported);
+    }
+    return EPD_REFRESH_PARTIAL;
+}
+
+// Account for an update that was started with mode
+_attribute_ram_code_ void refresh_policy_record(uint8_t mode, const struct epd_window *window, uint16_t width)
+{
+    int first, last, i;
+
+    if (mode == EPD_REFRESH_PARTIAL)
+    {
+        refresh_policy_span(window, width, &first, &last);
+        for (i = first; i <= last; i++)
+        {
+            if (refresh_partials[i] < 0xff)
+                refresh_partials[i]++;
+        }
+        return;
+    }
+    memset(refresh_partials, 0, sizeof(refresh_partials));
+    if (mode == EPD_REFRESH_FAST)
+        refresh_fast_run++;
+    else
+        refresh_fast_run = 0;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+
+struct epd_window;
+
+// Waveform choice for an EPD update, see refresh_policy.c. Drivers test
+// full_or_partial for 0, so EPD_REFRESH_FAST is a full refresh on panels
+// without a fast waveform.
+#define EPD_REFRESH_PARTIAL 0
+#define EPD_REFRESH_FULL 1
+#define EPD_REFRESH_FAST 2
+
+#define REFRESH_POLICY_REGIONS 8 // bands of panel rows with their own partial count
+
+// Thresholds, kept in the settings, in this order over RxTx
+struct refresh_policy_cfg
+{
+    uint8_t max_partials;  // partial refreshes of a region before it's cleaned
+    uint8_t max_fast;      // fast full refreshes in a row before a real full one
+    uint8_t change_pct;    // a partial window covering this much of the panel is cleaned instead
+    int8_t cold_temp;      // °C, partial waveforms are not used below this
+    int8_t fast_min_temp;  // °C, fast full refreshes are not used below this
+};
+
+extern const struct refresh_policy_cfg refresh_policy_default;
+
+void refresh_policy_init(void);
+void refresh_policy_set(const uint8_t *cfg);
+void refresh_policy_get(uint8_t *cfg);
+uint8_t refresh_policy_decide(uint8_t requested, const struct epd_window *window, uint16_t width, uint8_t fast_supported);
+void refresh_policy_record(uint8_t mode, const struct epd_window *window, uint16_t width);
+uint8_t refresh_policy_wear(void);
@@ -0,0 +1,71 @@
+#include <stdint.h>
+#include "tl_common.h"
+#include "drivers/8258/flash.h"
+#include "main.h"
+#include "epd.h"
+#include "schedule.h"
+
+// A table of weekday masks and times that switch the scene or show an image
+// slot, so a gateway can push a day of changes in one connection. It is kept
+// in retention RAM, saved to its own flash sector above the image slots and
+// checked by handler_time() once per minute.
+
+#define SCHEDULE_FLASH 0x70000
+#define SCHEDULE_MAGIC 0x53434844
+
+RAM struct schedule_entry schedule[SCHEDULE_ENTRIES];
+
+void schedule_init(void)
+{
+    uint32_t magic;
+
+    flash_read_page(SCHEDULE_FLASH, sizeof(magic), (uint8_t *)&magic);
+    if (magic == SCHEDULE_MAGIC)
+        flash_read_page(SCHEDULE_FLASH + sizeof(magic), sizeof(schedule), (uint8_t *)schedule);
+    else
+        memset(schedule, 0, sizeof(schedule));
+}
+
+// Set an entry from its 4 bytes (days, hour, minute, action), returns 0 for a bad index
+uint8_t schedule_set(uint8_t index, const uint8_t *entry)
+{
+    if (index >= SCHEDULE_ENTRIES)
+        return 0;
+    memcpy(&schedule[index], entry, sizeof(struct schedule_entry));
+    return 1;
+}
+
+uint8_t schedule_get(uint8_t index, uint8_t *entry)
+{
+    if (index >= SCHEDULE_ENTRIES)
+        return 0;
+    memcpy(entry, &schedule[index], sizeof(struct schedule_entry));
+    return 1;
+}
+
+void schedule_save(void)
+{
+    uint32_t magic = SCHEDULE_MAGIC;
+
+    flash_erase_sector(SCHEDULE_FLASH);
+    flash_write_page(SCHEDULE_FLASH, sizeof(magic), (uint8_t *)&magic);
+    flash_write_page(SCHEDULE_FLASH + sizeof(magic), sizeof(schedule), (uint8_t *)schedule);
+}
+
+// Apply the entries due at this minute, a later entry wins over an earlier one
+_attribute_ram_code_ void schedule_run(const struct date_time *now)
+{
+    struct schedule_entry *e;
+    uint8_t day = 1 << (now->tm_week % 7); // tm_week is 1..7 from Monday, or 0 for Sunday
+
+    for (e = schedule; e < &schedule[SCHEDULE_ENTRIES]; e++)
+    {
+        if (!e->action || e->action == 0xff || !(e->days & day)
+            || e->hour != now->tm_hour || e->minute != now->tm_min)
+            continue;
+        if (e->action & SCHEDULE_SLOT)
+            epd_show_slot(e->action & ~SCHEDULE_SLOT, e->days & SCHEDULE_FULL_REFRESH);
+        else
+            set_EPD_scene_refresh(e->action, e->days & SCHEDULE_FULL_REFRESH);
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+#include "etime.h"
+
+// Time-of-day content changes, see schedule.c
+#define SCHEDULE_ENTRIES 16
+
+#define SCHEDULE_FULL_REFRESH 0x80 // in days, next to the weekday bits
+#define SCHEDULE_SLOT 0x80         // in action, the low bits are the image slot
+
+struct schedule_entry
+{
+    uint8_t days;   // bit 0 Sunday .. bit 6 Saturday, SCHEDULE_FULL_REFRESH
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t action; // scene id, SCHEDULE_SLOT | slot, 0 or 0xff unused
+};
+
+void schedule_init(void);
+uint8_t schedule_set(uint8_t index, const uint8_t *entry);
+uint8_t schedule_get(uint8_t index, uint8_t *entry);
+void schedule_save(void);
+void schedule_run(const struct date_time *now);
@@ -27,6 +27,8 @@ static int TIFFInit(TIFFIMAGE *pTIFF);
 static int TIFFParseInfo(TIFFIMAGE *pPage);
 static void TIFFGetMoreData(TIFFIMAGE *pPage);
 static int Decode(TIFFIMAGE *pImage);
+static void DecodeStart(TIFFIMAGE *pPage);
+static int DecodeLines(TIFFIMAGE *pPage, int bFlush);
 
 // Scale to gray tables
 //
@@ -95,6 +97,25 @@ static const uint8_t ucMirror[256] PROGMEM =
       11, 139, 75, 203, 43, 171, 107, 235, 27, 155, 91, 219, 59, 187, 123, 251,
       7, 135, 71, 199, 39, 167, 103, 231, 23, 151, 87, 215, 55, 183, 119, 247,
       15, 143, 79, 207, 47, 175, 111, 239, 31, 159, 95, 223, 63, 191, 127, 255};
+/*
+ Number of V(0) codes (1 bits) at the start of the next 8 bits, so a run of
+ vertical edges is consumed with one lookup
+*/
+#ifndef G4_V0_TABLE
+#define G4_V0_TABLE 1
+#endif
+#if G4_V0_TABLE
+static const uint8_t ucV0Run[256] PROGMEM =
+       {0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,
+        1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+        1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,
+        2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,
+        3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,3,4,4,4,4,4,4,4,4,5,5,5,5,6,6,7,8};
+#endif
+
 /*
  The code tree that follows has: bit_length, decode routine
  These codes are for Group 4 (MMR) decoding
@@ -398,6 +419,76 @@ int TIFF_openRAW(TIFFIMAGE *pImage, int iWidth, int iHeight, int iFillOrder, uin
 
 } /* openRAW() */
 
+//
+// Push mode: raw G4 data is handed over in chunks with TIFF_pushData()
+// and lines are decoded as soon as enough data is buffered
+//
+int TIFF_openPush(TIFFIMAGE *pImage, int iWidth, int iHeight, int iFillOrder, TIFF_DRAW_CALLBACK *pfnDraw)
+{
+    if (iWidth > MAX_IMAGE_WIDTH - 2 || TIFF_PUSH_MARGIN(iWidth) > FILE_BUF_SIZE / 2)
+        return 0; // a whole line must fit in the buffer along with a chunk
+    memset(pImage, 0, sizeof(TIFFIMAGE));
+    pImage->pfnDraw = pfnDraw;
+    pImage->iWidth = iWidth;
+    pImage->iHeight = iHeight;
+    pImage->ucFillOrder = (uint8_t)iFillOrder;
+    DecodeStart(pImage);
+    return 1;
+
+} /* openPush() */
+
+int TIFF_pushData(TIFFIMAGE *pImage, const uint8_t *pData, int iLen)
+{
+    int i, iCount;
+
+    while (iLen > 0 && pImage->iError == 0 && pImage->iLine < pImage->iHeight)
+    {
+        if (pImage->iLine == 0 && pImage->iVLCSize == 0)
+        { // valid G4 data can't begin with a 0
+            while (iLen > 0 && *pData == 0)
+            { pData++; iLen--; }
+        }
+        if (pImage->iVLCOff != 0)
+        { // move the unused data down
+            memmove(&pImage->ucFileBuf[0], &pImage->ucFileBuf[pImage->iVLCOff], pImage->iVLCSize - pImage->iVLCOff);
+            pImage->iVLCSize -= pImage->iVLCOff;
+            pImage->iVLCOff = 0;
+        }
+        iCount = FILE_BUF_SIZE - 4 - pImage->iVLCSize; // keep room for the look-ahead
+        if (iCount > iLen)
+            iCount = iLen;
+        for (i=0; i<iCount; i++)
+        {
+            uint8_t c = pData[i];
+            if (pImage->ucFillOrder == BITDIR_LSB_FIRST)
+                c = pgm_read_byte(&ucMirror[c]);
+            pImage->ucFileBuf[pImage->iVLCSize + i] = c;
+        }
+        pImage->iVLCSize += iCount;
+        pData += iCount;
+        iLen -= iCount;
+        DecodeLines(pImage, 0);
+    }
+    return (pImage->iError == 0);
+
+} /* pushData() */
+
+int TIFF_pushEnd(TIFFIMAGE *pImage)
+{
+    if (pImage->iError == 0 && pImage->iLine < pImage->iHeight)
+    { // decode the remaining lines, reading zeros past the end of the data
+        memset(&pImage->ucFileBuf[pImage->iVLCSize], 0, FILE_BUF_SIZE - pImage->iVLCSize);
+        DecodeLines(pImage, 1);
+    }
+    return (pImage->iError == 0);
+
+} /* pushEnd() */
+
+int TIFF_getLinesDecoded(TIFFIMAGE *pImage)
+{
+    return pImage->iLine;
+} /* getLinesDecoded() */
+
 void TIFF_close(TIFFIMAGE *pImage)
 {
     if (pImage->pfnClose)
@@ -738,6 +829,17 @@ static void TIFFDrawLine(TIFFIMAGE *pPage, int y, int16_t *pCurFlips)
     obgd.iHeight = pPage->iHeight;
     obgd.iScaledWidth = (pPage->iWidth * u32ScaleFactor) >> 16;
     iStart = pPage->window.x;
+
+    if (pPage->window.ucPixelType == TIFF_PIXEL_SPANS)
+    { // let the callback draw the runs itself
+        obgd.y = y;
+        obgd.pPixels = NULL;
+        obgd.pFlips = pCurFlips;
+        obgd.ucPixelType = TIFF_PIXEL_SPANS;
+        obgd.ucLast = (y == pPage->iHeight-1);
+        (*pPage->pfnDraw)(&obgd);
+        return;
+    }
     
     if (y == pPage->window.y) // start first line at white
     {
@@ -864,17 +966,12 @@ static void TIFFDrawLine(TIFFIMAGE *pPage, int y, int16_t *pCurFlips)
     
 } /* TIFFDrawLine() */
 //
-// Decompress the VLC data
+// Prepare the flip lists and bit position for the first line
 //
-static int Decode(TIFFIMAGE *pPage)
+static void DecodeStart(TIFFIMAGE *pPage)
 {
-int i, y, xsize, tot_run, tot_run1 = 0;
-int32_t sCode;
-int16_t *t1, *pCur, *pRef;
+int i, xsize;
 int16_t *CurFlips, *RefFlips;
-uint32_t lBits;
-uint32_t ulBits, ulBitOff;
-uint8_t *pBuf, *pBufEnd;
 
     xsize = pPage->iWidth; /* For performance reasons */
     CurFlips = pPage->CurFlips;
@@ -893,22 +990,36 @@ uint8_t *pBuf, *pBufEnd;
     CurFlips[i+1] = RefFlips[i+1] = 0x7fff;
 
     pPage->iVLCSize = pPage->iVLCOff = 0;
-    (*pPage->pfnSeek)(&pPage->TIFFFile, pPage->iStripOffset); // start of data
-    TIFFGetMoreData(pPage); // read first block of compressed data
-    pBuf = pPage->ucFileBuf;
-    pBufEnd = &pBuf[FILE_HIGHWATER];
-    ulBitOff = 0;
+    pPage->iLine = 0;
+    pPage->ulBitOff = 0;
+} /* DecodeStart() */
 //
-// Some files may have leading 0's that would confuse the decoder
-// Valid G4 data can't begin with a 0
+// Decompress the VLC data
+// In push mode (no read callback) decoding stops at a line boundary when
+// fewer than TIFF_PUSH_MARGIN bytes are buffered, unless bFlush is set
 //
-   while (pBuf < pBufEnd && pBuf[0] == 0)
-   { pBuf++; }
+static int DecodeLines(TIFFIMAGE *pPage, int bFlush)
+{
+int y, xsize, tot_run, tot_run1 = 0;
+int32_t sCode;
+int16_t *t1, *pCur, *pRef;
+int16_t *CurFlips, *RefFlips;
+uint32_t lBits;
+uint32_t ulBits, ulBitOff;
+uint8_t *pBuf, *pBufEnd;
 
-   ulBits = MOTOLONG(pBuf); // load 32 bits to start
+    xsize = pPage->iWidth; /* For performance reasons */
+    y = pPage->iLine;
+    // the lists swap roles every line
+    CurFlips = (y & 1) ? pPage->RefFlips : pPage->CurFlips;
+    RefFlips = (y & 1) ? pPage->CurFlips : pPage->RefFlips;
+    pBuf = &pPage->ucFileBuf[pPage->iVLCOff];
+    pBufEnd = &pPage->ucFileBuf[FILE_HIGHWATER];
+    ulBitOff = pPage->ulBitOff;
+    ulBits = MOTOLONG(pBuf);
     
    /* Decode the image */
-   for (y=0; y < pPage->iHeight; y++)
+   for (; y < pPage->iHeight; y++)
       {
       signed int a0, a0_c, a0_p, b1;
 //g4_restart:
@@ -917,7 +1028,12 @@ uint8_t *pBuf, *pBufEnd;
       pRef = RefFlips;
       a0 = -1;
       a0_c = 0; /* start just to left and white */
-      if (pBuf >= pBufEnd) // time to read more data
+      if (pPage->pfnRead == NULL)
+      {
+          if (!bFlush && (&pPage->ucFileBuf[pPage->iVLCSize] - pBuf) < TIFF_PUSH_MARGIN(xsize))
+              break; // wait for more data to be pushed
+      }
+      else if (pBuf >= pBufEnd) // time to read more data
       {
           pPage->iVLCOff = (int)(pBuf - pPage->ucFileBuf);
           TIFFGetMoreData(pPage);
@@ -933,10 +1049,21 @@ uint8_t *pBuf, *pBufEnd;
             }
          if ((int32_t)(ulBits << ulBitOff) < 0)  /* V(0) code */
             {
+#if G4_V0_TABLE
+            int iRun = pgm_read_byte(&ucV0Run[(ulBits << ulBitOff) >> 24]);
+            do /* the line may end inside the run */
+               {
+               a0 = *pRef++;
+               *pCur++ = a0;
+               ulBitOff++; // 1 bit
+               a0_c ^= 1; /* color change */
+               } while (--iRun && a0 < xsize);
+#else
             a0 = *pRef++;
             ulBitOff++; // 1 bit
             a0_c = 1 - a0_c; /* color change */
             *pCur++ = a0;
+#endif
             }
          else /* Slow method */
             {
@@ -1153,10 +1280,27 @@ uint8_t *pBuf, *pBufEnd;
       CurFlips = t1;
       } /* for */
   pilreadg4z:
+    pPage->iLine = y;
+    pPage->iVLCOff = (int)(pBuf - pPage->ucFileBuf);
+    pPage->ulBitOff = ulBitOff;
 //    pOutPage->iLinesDecoded = y; // tell caller how many lines successfully decoded
 //   if (pPage->iOptions & PIL_CONVERT_IGNORE_ERRORS)
 //      pPage->iError = 0; // suppress errors
 
    return (pPage->iError == 0);
 
+} /* DecodeLines() */
+
+static int Decode(TIFFIMAGE *pPage)
+{
+    DecodeStart(pPage);
+    (*pPage->pfnSeek)(&pPage->TIFFFile, pPage->iStripOffset); // start of data
+    TIFFGetMoreData(pPage); // read first block of compressed data
+//
+// Some files may have leading 0's that would confuse the decoder
+// Valid G4 data can't begin with a 0
+//
+    while (pPage->iVLCOff < FILE_HIGHWATER && pPage->ucFileBuf[pPage->iVLCOff] == 0)
+    { pPage->iVLCOff++; }
+    return DecodeLines(pPage, 1);
 } /* Decode() */
@@ -0,0 +1,52 @@
+#include <stdint.h>
+#include "tl_common.h"
+#include "main.h"
+#include "work_queue.h"
+
+// Single producer, single consumer ring: the GATT write callbacks push, main_loop
+// pops after blt_sdk_main_loop(). Each side only writes its own index, so no
+// locking is needed, and EPD refreshes never run inside the BLE stack callbacks.
+
+struct work_item
+{
+    work_fn fn;
+    uint8_t arg[WORK_ARG_SIZE];
+};
+
+RAM struct work_item work_queue[WORK_QUEUE_SIZE];
+RAM volatile uint8_t work_queue_head; // next free item, written by the producer
+RAM volatile uint8_t work_queue_tail; // next item to run, written by the consumer
+
+// Returns 0 if the queue is full or the argument too long
+_attribute_ram_code_ uint8_t work_queue_push(work_fn fn, const void *arg, int len)
+{
+    uint8_t head = work_queue_head;
+    struct work_item *item = &work_queue[head & (WORK_QUEUE_SIZE - 1)];
+
+    if ((uint8_t)(head - work_queue_tail) >= WORK_QUEUE_SIZE || len > WORK_ARG_SIZE)
+        return 0;
+    item->fn = fn;
+    if (len)
+        memcpy(item->arg, arg, len);
+    work_queue_head = head + 1; // publish after the item is complete
+    return 1;
+}
+
+_attribute_ram_code_ uint8_t work_queue_pending(void)
+{
+    return work_queue_head != work_queue_tail;
+}
+
+// Run the queued work in order, stops at the first item that asks to be retried
+_attribute_ram_code_ void work_queue_run(void)
+{
+    uint8_t tail = work_queue_tail;
+
+    while (tail != work_queue_head)
+    {
+        struct work_item *item = &work_queue[tail & (WORK_QUEUE_SIZE - 1)];
+        if (!item->fn(item->arg))
+            break;
+        work_queue_tail = ++tail;
+    }
+}
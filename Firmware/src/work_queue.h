@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Work deferred from the BLE callbacks to main_loop, see work_queue.c
+#define WORK_QUEUE_SIZE 8 // power of two
+#define WORK_ARG_SIZE 8
+
+// Returns 0 to stay queued and be retried on the next pass, e.g. while the panel is busy
+typedef uint8_t (*work_fn)(const uint8_t *arg);
+
+uint8_t work_queue_push(work_fn fn, const void *arg, int len);
+uint8_t work_queue_pending(void);
+void work_queue_run(void);
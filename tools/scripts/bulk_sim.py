@@ -0,0 +1,167 @@
+import argparse
+import heapq
+import random
+
+# Loopback model of the EPD upload over a BLE link: the client side follows
+# web_tools/index.html, the device side Firmware/src/epd_ble_service.c.
+#
+# The link carries up to PER_EVENT packets in each direction per connection
+# event. Writes without response and notifications can be dropped (browser
+# or controller queue overflow), writes with response cannot.
+
+ACK_CHUNKS = 64
+PLANE = 4736
+
+
+class Link:
+    def __init__(self, interval_ms, latency_ms, loss, per_event, rng):
+        self.interval = interval_ms
+        self.latency = latency_ms
+        self.loss = loss
+        self.per_event = per_event
+        self.rng = rng
+        self.slots = {}  # (direction, event) -> packets already scheduled
+
+    def deliver_at(self, now, direction, lossy=True):
+        """Arrival time of a packet handed to the stack at now, None if lost"""
+        event = int((now + self.latency) // self.interval) + 1
+        while self.slots.get((direction, event), 0) >= self.per_event:
+            event += 1
+        self.slots[(direction, event)] = self.slots.get((direction, event), 0) + 1
+        if lossy and self.rng.random() < self.loss:
+            return None
+        return event * self.interval + self.latency
+
+
+class Device:
+    """Commands 0x07-0x09 of epd_ble_handle_write()"""
+
+    def __init__(self):
+        self.plane = bytearray(PLANE)
+        self.chunks = 0
+
+    def start(self, chunk_size, chunks, ack_every):
+        self.chunk_size, self.chunks, self.ack_every = chunk_size, chunks, ack_every
+        self.seen = [False] * chunks
+        self.base = self.top = self.since_ack = 0
+        return self.ack()
+
+    def chunk(self, seq, data):
+        if seq >= self.chunks:
+            return None
+        if not self.seen[seq]:
+            self.plane[seq * self.chunk_size:seq * self.chunk_size + len(data)] = data
+            self.seen[seq] = True
+            self.top = max(self.top, seq + 1)
+            while self.base < self.chunks and self.seen[self.base]:
+                self.base += 1
+        self.since_ack += 1
+        if self.since_ack >= self.ack_every or self.base == self.chunks:
+            return self.ack()
+        return None
+
+    def ack(self):
+        self.since_ack = 0
+        missing = [seq for seq in range(self.base, min(self.top, self.base + ACK_CHUNKS)) if not self.seen[seq]]
+        return self.base, self.top, missing
+
+
+def stop_and_wait(data, link, chunk=240):
+    """Command 0x03: one write with response and one notify per chunk"""
+    now = 0.0
+    for _ in range(0, len(data), chunk):
+        now = link.deliver_at(now, 'up', lossy=False)
+        now = link.deliver_at(now, 'down', lossy=False)
+    return now
+
+
+def windowed(data, link, chunk=240, window=16, ack_every=8):
+    """Commands 0x07-0x09: writes without response, selective acks"""
+    device = Device()
+    chunks = -(-len(data) // chunk)
+    rto = 2 * (link.interval + link.latency) * 2
+    events = []  # (time, order, kind, payload)
+    order = 0
+
+    def send(now, kind, payload, direction, lossy=True):
+        nonlocal order
+        at = link.deliver_at(now, direction, lossy)
+        if at is not None:
+            order += 1
+            heapq.heappush(events, (at, order, kind, payload))
+
+    send(0.0, 'start', None, 'up', lossy=False)
+    base = top = 0
+    next_new = 0
+    last_sent = {}
+    last_ack = 0.0
+    retransmit = []
+    sent_packets = 0
+    while events:
+        now, _, kind, payload = heapq.heappop(events)
+        if kind == 'start':
+            send(now, 'ack', device.start(chunk, chunks, ack_every), 'down', lossy=False)
+            continue
+        if kind == 'chunk':
+            ack = device.chunk(payload, data[payload * chunk:(payload + 1) * chunk])
+            if ack:
+                send(now, 'ack', ack, 'down')
+            continue
+        if kind == 'poll':
+            send(now, 'ack', device.ack(), 'down')
+            continue
+        if kind == 'timer':
+            if base < chunks and now - last_ack >= rto:
+                send(now, 'poll', None, 'up', lossy=False)
+                last_ack = now
+                order += 1
+                heapq.heappush(events, (now + rto, order, 'timer', None))
+            continue
+        # ack on the client
+        base, top, missing = max(base, payload[0]), payload[1], payload[2]
+        last_ack = now
+        if base == chunks:
+            assert device.plane[:len(data)] == data
+            return now, sent_packets
+        for seq in missing:
+            if now - last_sent.get(seq, -rto) >= rto and seq not in retransmit:
+                retransmit.append(seq)
+        if top <= next_new and next_new - top > 0 and now - last_sent[next_new - 1] >= rto:
+            retransmit.extend(s for s in range(top, next_new) if s not in retransmit)  # lost tail
+        while retransmit or (next_new < chunks and next_new - base < window):
+            if retransmit:
+                seq = retransmit.pop(0)
+            else:
+                seq = next_new
+                next_new += 1
+            last_sent[seq] = now
+            sent_packets += 1
+            send(now, 'chunk', seq, 'up')
+        order += 1
+        heapq.heappush(events, (now + rto, order, 'timer', None))
+    raise RuntimeError('transfer stalled')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Upload time and goodput of one plane')
+    parser.add_argument('--interval', type=float, default=50, help='connection interval in ms')
+    parser.add_argument('--latency', type=float, default=10, help='extra one-way stack latency in ms')
+    parser.add_argument('--per-event', type=int, default=4, help='packets per connection event and direction')
+    parser.add_argument('--window', type=int, default=16)
+    parser.add_argument('--ack-every', type=int, default=8)
+    parser.add_argument('--runs', type=int, default=20)
+    args = parser.parse_args()
+
+    plane = bytes(random.Random(0).getrandbits(8) for _ in range(PLANE))
+    base_ms = stop_and_wait(plane, Link(args.interval, args.latency, 0, args.per_event, random.Random(0)))
+    print(f'0x03 stop-and-wait       {base_ms / 1000:5.2f} s  {len(plane) / base_ms:5.2f} kB/s')
+    for loss in (0.0, 0.01, 0.05, 0.1, 0.2):
+        times, packets = [], []
+        for run in range(args.runs):
+            link = Link(args.interval, args.latency, loss, args.per_event, random.Random(run))
+            ms, sent = windowed(plane, link, window=args.window, ack_every=args.ack_every)
+            times.append(ms)
+            packets.append(sent)
+        ms = sum(times) / len(times)
+        print(f'0x07 windowed, loss {loss:4.0%} {ms / 1000:5.2f} s  {len(plane) / ms:5.2f} kB/s'
+              f'  {sum(packets) / len(packets) / -(-PLANE // 240):4.2f} sends per chunk')
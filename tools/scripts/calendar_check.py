@@ -0,0 +1,97 @@
+import datetime
+import os
+import random
+import shutil
+import subprocess
+import tempfile
+
+SRC = os.path.join(os.path.dirname(__file__), '..', '..', 'Firmware', 'src')
+
+# etime.c is built on the host with stubs for the SDK, main.h is shadowed by
+# copying etime.c next to the stubs
+STUBS = {
+    'tl_common.h': '#pragma once\n#include <stdint.h>\n#include <stddef.h>\n',
+    'drivers.h': '#pragma once\nunsigned int get_32k_tick(void);\n',
+    'stack/ble/ble.h': '',
+    'drivers/8258/flash.h': '',
+    'main.h': '#pragma once\n#include <stdint.h>\n#define RAM\n#define _attribute_ram_code_\n#include "flash.h"\n',
+}
+
+# Prints "days year month day weekday" for every day given on stdin as a day
+# number, and "unix zone hour minute second year month day weekday" for lines
+# with a time and a time zone
+HARNESS = r'''
+#include <stdio.h>
+#include <stdint.h>
+#include "etime.h"
+#include "flash.h"
+settings_struct settings;
+extern uint32_t current_unix_time;
+unsigned int get_32k_tick(void) { return 0; }
+void save_settings_to_flash(void) {}
+void schedule_run(const struct date_time *now) {}
+int main(void) {
+    unsigned long a;
+    long zone;
+    char line[64];
+    struct date_time d;
+    while (fgets(line, sizeof(line), stdin)) {
+        if (sscanf(line, "%lu %ld", &a, &zone) == 2) {
+            set_time_zone((int16_t)zone);
+            current_unix_time = a;
+            d = get_time();
+            printf("%lu %ld %d %d %d %d %d %d %d\n", a, zone, d.tm_hour, d.tm_min, d.tm_sec,
+                   d.tm_year, d.tm_month, d.tm_day, d.tm_week);
+        } else {
+            time_date_from_days(a, &d);
+            printf("%lu %d %d %d %d\n", a, d.tm_year, d.tm_month, d.tm_day, d.tm_week);
+        }
+    }
+    return 0;
+}
+'''
+
+
+def build(tmp):
+    for name, text in STUBS.items():
+        os.makedirs(os.path.dirname(os.path.join(tmp, name)), exist_ok=True)
+        with open(os.path.join(tmp, name), 'w') as f:
+            f.write(text)
+    shutil.copy(os.path.join(SRC, 'etime.c'), tmp)
+    with open(os.path.join(tmp, 'harness.c'), 'w') as f:
+        f.write(HARNESS)
+    exe = os.path.join(tmp, 'etime')
+    subprocess.run(['gcc', '-O2', '-w', '-fpack-struct', '-I', tmp, '-I', SRC,
+                    os.path.join(tmp, 'harness.c'), os.path.join(tmp, 'etime.c'), '-o', exe], check=True)
+    return exe
+
+
+if __name__ == '__main__':
+    epoch = datetime.datetime(1970, 1, 1)
+    last_day = (datetime.datetime(2106, 2, 7) - epoch).days  # uint32 seconds end here
+    rng = random.Random(0)
+    instants = [(rng.randrange(1 << 32), rng.randrange(-720, 841, 15)) for _ in range(100000)]
+    instants = [(t, z) for t, z in instants if 0 <= t + z * 60 < 1 << 32]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        stdin = ''.join(f'{d}\n' for d in range(last_day + 1))
+        stdin += ''.join(f'{t} {z}\n' for t, z in instants)
+        out = subprocess.run([build(tmp)], input=stdin, check=True, capture_output=True, text=True).stdout
+
+    errors = 0
+    for line in out.splitlines():
+        fields = list(map(int, line.split()))
+        if len(fields) == 5:
+            day, got = fields[0], fields[1:]
+            date = epoch + datetime.timedelta(days=day)
+            expect = [date.year, date.month, date.day, date.isoweekday()]
+        else:
+            (t, zone), got = fields[:2], fields[2:]
+            date = epoch + datetime.timedelta(seconds=t + zone * 60)
+            expect = [date.hour, date.minute, date.second, date.year, date.month, date.day, date.isoweekday()]
+        if got != expect:
+            errors += 1
+            if errors <= 10:
+                print('mismatch', fields[:2], got, expect)
+    print(f'{last_day + 1} days 1970-01-01..2106-02-07 and {len(instants)} local times checked, {errors} mismatches')
+    raise SystemExit(errors != 0)
@@ -0,0 +1,42 @@
+from PIL import ImageDraw
+
+from tools.scripts.g4_bench import label
+from tools.utils import delta_apply, delta_encode, hex2bytes, image2hex
+
+WIDTH, HEIGHT = 296, 128
+STRIDE = HEIGHT // 8
+
+
+def plane(image):
+    return hex2bytes(image2hex(image, width=WIDTH, height=HEIGHT))
+
+
+def bench(name, old_image, new_image):
+    old, new = plane(old_image), plane(new_image)
+    packets = delta_encode(old, new)
+    assert delta_apply(old, packets) == new
+    changed = [i for i in range(len(new)) if old[i] != new[i]]
+    rows = changed[-1] // STRIDE - changed[0] // STRIDE + 1
+    columns = {i % STRIDE for i in changed}
+    window = rows * (max(columns) - min(columns) + 1)
+    print(f'{name:14} full {len(new):5} B  delta {sum(len(p) + 2 for p in packets):4} B in {len(packets)} writes  '
+          f'refresh window {rows} rows x {max(columns) - min(columns) + 1} bytes = {window} B')
+
+
+if __name__ == '__main__':
+    # bytes on air and panel RAM bytes written for typical label edits
+    base = label(WIDTH, HEIGHT, 1)
+
+    price = base.copy()
+    draw = ImageDraw.Draw(price)
+    draw.rectangle((8, 24, 80, 34), fill=1)
+    draw.text((8, 24), '0,99 EUR', fill=0)
+    bench('price', base, price)
+
+    text = base.copy()
+    draw = ImageDraw.Draw(text)
+    draw.rectangle((8, 8, WIDTH - 8, 18), fill=1)
+    draw.text((8, 8), 'ITEM 0001  organic soy milk 1L', fill=0)
+    bench('product name', base, text)
+
+    bench('new label', base, label(WIDTH, HEIGHT, 2))
@@ -0,0 +1,110 @@
+import os
+import statistics
+import subprocess
+import tempfile
+
+from PIL import Image, ImageDraw
+from PIL.Image import Dither  # noqa
+
+from tools.utils import image2g4, load_test_image
+
+SRC = os.path.join(os.path.dirname(__file__), '..', '..', 'Firmware', 'src')
+ROUNDS = 5000
+
+# Decodes every file given on the command line ROUNDS times, each decode timed
+# on its own, and prints the median and the fastest time per frame in us
+HARNESS = r'''
+#include <stdio.h>
+#include <time.h>
+#include "TIFF_G4.h"
+static unsigned sum;
+static void draw(TIFFDRAW *p) { sum += p->pPixels[p->y & 15]; }
+static TIFFIMAGE t;
+static double us[%d];
+static int cmp(const void *a, const void *b) { return *(const double *)a < *(const double *)b ? -1 : *(const double *)a > *(const double *)b; }
+int main(int argc, char **argv) {
+    static uint8_t buf[65536];
+    int a, w = atoi(argv[1]), h = atoi(argv[2]);
+    for (a = 3; a < argc; a++) {
+        FILE *f = fopen(argv[a], "rb");
+        int i, n = (int)fread(buf, 1, sizeof(buf), f), ok = 1;
+        struct timespec t0, t1;
+        fclose(f);
+        for (i = 0; i < %d; i++) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            TIFF_openRAW(&t, w, h, BITDIR_MSB_FIRST, buf, n, draw);
+            TIFF_setDrawParameters(&t, 65536, TIFF_PIXEL_1BPP, 0, 0, w, h, NULL);
+            ok &= TIFF_decode(&t);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            us[i] = (t1.tv_sec - t0.tv_sec) * 1e6 + (t1.tv_nsec - t0.tv_nsec) / 1e3;
+        }
+        qsort(us, %d, sizeof(us[0]), cmp);
+        printf("%%d %%.2f %%.2f %%u\n", ok, us[%d / 2], us[0], sum);
+    }
+    return 0;
+}
+''' % (ROUNDS, ROUNDS, ROUNDS, ROUNDS)
+
+
+def label(width, height, seed):
+    """A shelf label: price, a line of text and a barcode"""
+    image = Image.new('1', (width, height), 1)
+    draw = ImageDraw.Draw(image)
+    draw.rectangle((2, 2, width - 3, height - 3), outline=0)
+    draw.text((8, 8), f'ITEM {seed:04}  organic oat milk 1L', fill=0)
+    draw.text((8, 24), f'{seed % 10},{seed % 97:02} EUR', fill=0)
+    draw.rectangle((8, 40, width // 2, 70), fill=0)
+    x = 10
+    while x < width - 12:
+        bar = 1 + (x * 7 + seed) % 3
+        draw.rectangle((x, height - 45, x + bar - 1, height - 10), fill=0)
+        x += bar + 1 + (x + seed) % 2
+    return image
+
+
+def build(tmp, v0_table):
+    exe = os.path.join(tmp, f'g4_{v0_table}')
+    harness = os.path.join(tmp, 'harness.c')
+    with open(harness, 'w') as f:
+        f.write('#include <stdlib.h>\n' + HARNESS)
+    subprocess.run(['gcc', '-O2', f'-DG4_V0_TABLE={v0_table}', '-I', SRC,
+                    harness, os.path.join(SRC, 'tiffg4.c'), '-o', exe], check=True)
+    return exe
+
+
+def run(exes, width, height, files, repeat=7):
+    """Median over the runs of the median and the fastest time per frame, as
+    (ok, median us, fastest us) per file and exe. The exes take turns so that
+    a change of CPU clock hits all of them alike."""
+    results = [[] for _ in exes]
+    for _ in range(repeat):
+        for exe, result in zip(exes, results):
+            out = subprocess.run([exe, str(width), str(height)] + files, check=True,
+                                 capture_output=True, text=True).stdout.split('\n')
+            result.append([line.split() for line in out if line])
+    return [[(all(int(r[i][0]) for r in result), statistics.median(float(r[i][1]) for r in result),
+              statistics.median(float(r[i][2]) for r in result)) for i in range(len(files))]
+            for result in results]
+
+
+if __name__ == '__main__':
+    # decode time per frame, bit-by-bit V(0) path against the V(0) run table
+    corpus = [(f'label-{seed}', label(250, 122, seed), Dither.NONE) for seed in (1, 2, 3)]
+    corpus += [(name, load_test_image(name), dither) for name, dither in
+               (('test-01.bmp', Dither.NONE), ('test-02.bmp', Dither.NONE),
+                ('car-sign.png', Dither.NONE), ('mao.bmp', Dither.FLOYDSTEINBERG))]
+
+    with tempfile.TemporaryDirectory() as tmp:
+        files, sizes = [], []
+        for name, image, dither in corpus:
+            data = image2g4(image, 250, 122, dither)
+            files.append(os.path.join(tmp, name + '.g4'))
+            sizes.append(len(data))
+            with open(files[-1], 'wb') as f:
+                f.write(data)
+        old, new = run([build(tmp, 0), build(tmp, 1)], 250, 122, files)
+
+    print(f'{"":14} {"":10}  median us: bitwise   table         fastest us: bitwise   table')
+    for (name, _, _), size, (ok0, m0, f0), (ok1, m1, f1) in zip(corpus, sizes, old, new):
+        assert ok0 and ok1, name
+        print(f'{name:14} G4 {size:5} B  {m0:17.2f} {m1:7.2f} {m0 / m1:5.2f}x  {f0:18.2f} {f1:7.2f} {f0 / f1:5.2f}x')
@@ -0,0 +1,40 @@
+import time
+
+from PIL.Image import Dither  # noqa
+
+from tools.utils import hex2bytes, image2hex, load_test_image, lz_compress, lz_decompress
+
+# Upload as done by web_tools/index.html: one write with response per chunk
+RAW_CHUNK = 240         # command 0x03: 4 header bytes + 240 image bytes
+LZ_CHUNK = 242          # command 0x05: 2 header bytes + 242 compressed bytes
+CONN_INTERVAL_MS = 50   # 40 * 1.25 ms, requested by the firmware on command 0x00
+WRITES_PER_INTERVAL = 0.5  # a write with response takes about two connection events
+
+
+def air_time_ms(size, chunk, header):
+    packets = -(-size // chunk)
+    return packets, size + packets * header, packets * CONN_INTERVAL_MS / WRITES_PER_INTERVAL
+
+
+def bench(name, dither):
+    plane = hex2bytes(image2hex(load_test_image(name), width=296, height=128, dither=dither))
+
+    start = time.time()
+    packed = lz_compress(plane)
+    encode_ms = (time.time() - start) * 1000
+    assert lz_decompress(packed, len(plane)) == plane
+
+    raw_packets, raw_bytes, raw_ms = air_time_ms(len(plane), RAW_CHUNK, 4)
+    lz_packets, lz_bytes, lz_ms = air_time_ms(len(packed), LZ_CHUNK, 2)
+    print(f'{name:14} plane {len(plane):5} B  '
+          f'raw {raw_packets:3} writes {raw_bytes:5} B ~{raw_ms / 1000:4.1f} s  '
+          f'lz {lz_packets:3} writes {lz_bytes:5} B ~{lz_ms / 1000:4.1f} s  '
+          f'ratio {len(plane) / len(packed):5.1f}x  encode {encode_ms:.0f} ms')
+
+
+if __name__ == '__main__':
+    # bytes on air and time until the display command can be sent, per black plane
+    bench('test-01.bmp', Dither.NONE)
+    bench('test-02.bmp', Dither.NONE)
+    bench('car-sign.png', Dither.NONE)
+    bench('mao.bmp', Dither.FLOYDSTEINBERG)
@@ -0,0 +1,101 @@
+import os
+import shutil
+import subprocess
+import tempfile
+
+from tools.scripts.calendar_check import SRC, STUBS
+
+# etime.c and schedule.c are built on the host with the 32k timer, the flash
+# and the EPD calls stubbed. epd.h is shadowed, the EPD calls of the schedule
+# are printed as "scene <id>" or "slot <n>".
+SCHEDULE_STUBS = dict(STUBS)
+SCHEDULE_STUBS['main.h'] = STUBS['main.h'] + '#include <string.h>\n'
+SCHEDULE_STUBS['epd.h'] = ('#pragma once\n#include <stdint.h>\n'
+                           'void set_EPD_scene_refresh(uint8_t scene, uint8_t full_refresh);\n'
+                           'void epd_show_slot(uint8_t slot, uint8_t full_or_partial);\n')
+
+HARNESS = r'''
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "etime.h"
+#include "flash.h"
+#include "schedule.h"
+settings_struct settings;
+static unsigned int tick;
+unsigned int get_32k_tick(void) { return tick; }
+void save_settings_to_flash(void) {}
+void flash_read_page(unsigned long addr, unsigned long len, unsigned char *buf) { memset(buf, 0xff, len); }
+void flash_write_page(unsigned long addr, unsigned long len, unsigned char *buf) {}
+void flash_erase_sector(unsigned long addr) {}
+void set_EPD_scene_refresh(uint8_t scene, uint8_t full_refresh) { printf("scene %d\n", scene); }
+void epd_show_slot(uint8_t slot, uint8_t full_or_partial) { printf("slot %d\n", slot); }
+
+/* Commands on stdin: "entry <index> <days> <hour> <minute> <action>",
+   "sleep <seconds>" runs the clock and wakes up once, "sync <unix time>" sets it like 0xDD */
+int main(void) {
+    char line[64];
+    unsigned long a[5];
+
+    init_time();
+    schedule_init();
+    while (fgets(line, sizeof(line), stdin)) {
+        if (sscanf(line, "entry %lu %lu %lu %lu %lu", &a[0], &a[1], &a[2], &a[3], &a[4]) == 5) {
+            uint8_t entry[4] = {a[1], a[2], a[3], a[4]};
+            schedule_set(a[0], entry);
+        } else if (sscanf(line, "sleep %lu", &a[0]) == 1) {
+            tick += a[0] * 32000;
+            handler_time();
+        } else if (sscanf(line, "sync %lu", &a[0]) == 1) {
+            set_time(a[0]);
+        }
+    }
+    return 0;
+}
+'''
+
+
+def build(tmp):
+    for name, text in SCHEDULE_STUBS.items():
+        os.makedirs(os.path.dirname(os.path.join(tmp, name)), exist_ok=True)
+        with open(os.path.join(tmp, name), 'w') as f:
+            f.write(text)
+    for name in ('etime.c', 'schedule.c'):
+        shutil.copy(os.path.join(SRC, name), tmp)
+    with open(os.path.join(tmp, 'harness.c'), 'w') as f:
+        f.write(HARNESS)
+    exe = os.path.join(tmp, 'schedule')
+    subprocess.run(['gcc', '-O2', '-w', '-fpack-struct', '-I', tmp, '-I', SRC, os.path.join(tmp, 'harness.c'),
+                    os.path.join(tmp, 'etime.c'), os.path.join(tmp, 'schedule.c'), '-o', exe], check=True)
+    return exe
+
+
+def run(exe, commands):
+    return subprocess.run([exe], input=''.join(c + '\n' for c in commands), check=True, capture_output=True,
+                          text=True).stdout.split('\n')[:-1]
+
+
+# 2024-01-04 was a Thursday, like 1970-01-01 the clock counts from at boot
+THURSDAY = 1704326400
+CASES = [
+    ('no entry runs before the first sync',
+     ['entry 0 127 0 5 2', 'entry 1 127 0 7 130', 'sleep 60', 'sleep 900'], []),
+    ('entries run once synced',
+     ['entry 0 127 0 5 2', 'sleep 900', f'sync {THURSDAY + 4 * 60 + 30}', 'sleep 180'],
+     ['scene 2']),
+    ('every minute passed in one sleep runs, in order',
+     ['entry 0 127 0 5 2', 'entry 1 127 0 7 130', f'sync {THURSDAY}', 'sleep 600'],
+     ['scene 2', 'slot 2']),
+]
+
+if __name__ == '__main__':
+    errors = 0
+    with tempfile.TemporaryDirectory() as tmp:
+        exe = build(tmp)
+        for name, commands, expect in CASES:
+            got = run(exe, commands)
+            if got != expect:
+                errors += 1
+                print('failed:', name, got, expect)
+    print(f'{len(CASES)} schedule cases checked, {errors} failed')
+    raise SystemExit(errors != 0)
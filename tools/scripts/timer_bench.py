@@ -0,0 +1,137 @@
+import argparse
+import os
+import subprocess
+import tempfile
+
+SOFT_TIMER = 'Firmware/components/vendor/common/blt_soft_timer.c'
+ROOT = os.path.join(os.path.dirname(__file__), '..', '..')
+ROUNDS = 20000
+
+# Just enough of the SDK to build blt_soft_timer.c on the host, the clock is
+# driven by the harness
+TL_COMMON = r'''
+#pragma once
+#include <string.h>
+typedef unsigned char u8;
+typedef unsigned int u32;
+#define BIT(n) (1u << (n))
+#define CLOCK_16M_SYS_TIMER_CLK_1US 16
+#define CLOCK_16M_SYS_TIMER_CLK_1MS 16000
+#define CLOCK_16M_SYS_TIMER_CLK_1S 16000000
+#define _attribute_data_retention_
+#define write_reg32(a, v)
+u32 clock_time(void);
+void bls_pm_setAppWakeupLowPower(u32 wakeup_tick, u8 enable);
+void bls_pm_registerAppWakeupLowPowerCb(void (*cb)(int));
+'''
+
+# Cycles (rdtsc) per blt_soft_timer_add() while filling the table, per
+# blt_soft_timer_process() that fires the earliest timer and per
+# delete + add of a timer in the middle of the table
+HARNESS = r'''
+#include <stdio.h>
+#include <x86intrin.h>
+#include "tl_common.h"
+#include "vendor/common/blt_soft_timer.h"
+
+extern blt_soft_timer_t blt_timer;
+static u32 now;
+static unsigned fired[16];
+u32 clock_time(void) { return now; }
+void bls_pm_setAppWakeupLowPower(u32 wakeup_tick, u8 enable) {}
+void bls_pm_registerAppWakeupLowPowerCb(void (*cb)(int)) {}
+
+#define CB(i) static int cb##i(void) { fired[i] += now; return 0; }
+CB(0) CB(1) CB(2) CB(3) CB(4) CB(5) CB(6) CB(7) CB(8) CB(9) CB(10) CB(11) CB(12) CB(13) CB(14) CB(15)
+static blt_timer_callback_t cbs[16] = {cb0, cb1, cb2, cb3, cb4, cb5, cb6, cb7, cb8, cb9, cb10, cb11, cb12, cb13, cb14, cb15};
+
+static u32 interval(int i) { return 1000 + (i * 7919) %% 3001; }
+
+int main(void) {
+    unsigned long long t0, add = 0, process = 0, replace = 0;
+    unsigned sum = 0;
+    int i, r, n = MAX_TIMER_NUM;
+
+    for (r = 0; r < %d; r++) {
+        blt_timer.currentNum = 0;
+        now = r * 1234567u;
+        for (i = 0; i < n; i++) {
+            t0 = __rdtsc();
+            blt_soft_timer_add(cbs[i], interval(i));
+            add += __rdtsc() - t0;
+        }
+        now = blt_timer.timer[0].t;
+        t0 = __rdtsc();
+        blt_soft_timer_process(MAINLOOP_ENTRY);
+        process += __rdtsc() - t0;
+        t0 = __rdtsc();
+        blt_soft_timer_delete(cbs[n / 2]);
+        blt_soft_timer_add(cbs[n / 2], interval(r));
+        replace += __rdtsc() - t0;
+    }
+    /* fire order check: run the table for a while, the sum must match between builds */
+    for (r = 0; r < 10000; r++) {
+        now = blt_timer.timer[0].t;
+        blt_soft_timer_process(MAINLOOP_ENTRY);
+    }
+    for (i = 0; i < n; i++)
+        sum = sum * 31 + fired[i];
+    printf("%%.1f %%.1f %%.1f %%08x\n", (double)add / %d / n, (double)process / %d, (double)replace / %d, sum);
+    return 0;
+}
+''' % (ROUNDS, ROUNDS, ROUNDS, ROUNDS)
+
+
+def build(tmp, source, timers, name):
+    os.makedirs(os.path.join(tmp, 'stack', 'ble'), exist_ok=True)
+    with open(os.path.join(tmp, 'tl_common.h'), 'w') as f:
+        f.write(TL_COMMON)
+    with open(os.path.join(tmp, 'stack', 'ble', 'ble.h'), 'w') as f:
+        f.write('#pragma once\n#include "tl_common.h"\n')
+    harness = os.path.join(tmp, 'harness.c')
+    with open(harness, 'w') as f:
+        f.write(HARNESS)
+    # the timer source includes its header as "../common/blt_soft_timer.h"
+    common = os.path.join(tmp, name, 'common')
+    os.makedirs(common, exist_ok=True)
+    with open(os.path.join(common, 'blt_soft_timer.c'), 'w', encoding='utf-8') as f:
+        f.write(source)
+    with open(os.path.join(common, 'blt_soft_timer.h'), 'w') as f:
+        f.write(open(os.path.join(ROOT, SOFT_TIMER[:-1] + 'h')).read())
+    exe = os.path.join(tmp, f'{name}_{timers}')
+    subprocess.run(['gcc', '-O2', f'-DMAX_TIMER_NUM={timers}', '-I', tmp, '-I', os.path.join(tmp, name),
+                    '-I', os.path.join(ROOT, 'Firmware', 'components'),
+                    harness, os.path.join(common, 'blt_soft_timer.c'), '-o', exe], check=True)
+    return exe
+
+
+def run(exe, repeat=5):
+    """Best of several runs, as (add, process, replace, fire checksum)"""
+    best = None
+    for _ in range(repeat):
+        add, process, replace, check = subprocess.run([exe], check=True, capture_output=True,
+                                                      text=True).stdout.split()
+        result = [float(add), float(process), float(replace), check]
+        best = result if best is None else [min(a, b) for a, b in zip(result[:3], best[:3])] + [check]
+    return best
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Host cycle counts of blt_soft_timer operations')
+    parser.add_argument('--against', help='git revision to compare the soft timer with')
+    args = parser.parse_args()
+
+    sources = [('tree', open(os.path.join(ROOT, SOFT_TIMER), encoding='utf-8').read())]
+    if args.against:
+        sources.insert(0, (args.against, subprocess.run(['git', 'show', f'{args.against}:{SOFT_TIMER}'], cwd=ROOT,
+                                                         check=True, capture_output=True, text=True).stdout))
+
+    print(f'{"":12} {"timers":>6} {"add":>8} {"process":>8} {"del+add":>8}   cycles')
+    with tempfile.TemporaryDirectory() as tmp:
+        for timers in (4, 8, 16):
+            checks = set()
+            for i, (name, source) in enumerate(sources):
+                add, process, replace, check = run(build(tmp, source, timers, f'src{i}'))
+                checks.add(check)
+                print(f'{name:12} {timers:6} {add:8.1f} {process:8.1f} {replace:8.1f}')
+            assert len(checks) == 1, 'timers fired in a different order'
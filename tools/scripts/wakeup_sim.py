@@ -0,0 +1,119 @@
+import argparse
+import os
+import subprocess
+import tempfile
+
+from tools.scripts.timer_bench import ROOT, SOFT_TIMER, TL_COMMON
+
+# What RxTx command E8 counts for an hour of the app timers (app.c), with the
+# PM layer modelled as waking up for every BLE event and for the app wakeup
+# blt_soft_timer programs. Each wakeup is one main_loop pass. Without the app
+# wakeup (polled) the timers only run on BLE events, like the old loop.
+# Prints wakeups per hour and how late the minute tick and the other timers
+# ran at most, in ms, over runs with the BLE events at different offsets.
+HARNESS = r'''
+#include <stdio.h>
+#include "tl_common.h"
+#include "vendor/common/blt_soft_timer.h"
+
+#define US 16ull
+static unsigned long long now; /* 16 MHz ticks */
+static u32 app_wakeup;
+static u8 app_wakeup_on;
+static unsigned long long minute_late, timer_late;
+extern blt_soft_timer_t blt_timer;
+#define PHASES 16
+u32 clock_time(void) { return (u32)now; }
+void bls_pm_setAppWakeupLowPower(u32 wakeup_tick, u8 enable) { app_wakeup = wakeup_tick; app_wakeup_on = enable; }
+void bls_pm_registerAppWakeupLowPowerCb(void (*cb)(int)) {}
+
+/* how late the timer being run (timer[0]) is, in us */
+static void record_late(unsigned long long *max)
+{
+    u32 late = (u32)now - blt_timer.timer[0].t;
+    if (late < BIT(31) && late / US > *max)
+        *max = late / US;
+}
+
+static unsigned long long us_to_next_minute(void) { return 60000000ull - now / US %% 60000000ull; }
+static int minute_tick(void) { record_late(&minute_late); return us_to_next_minute() + 1000; }
+static int sensor_tick(void) { record_late(&timer_late); return 30 * 1000 * 1000; }
+static int led_tick(void) { record_late(&timer_late); return 10 * 1000 * 1000; }
+
+int main(int argc, char **argv) {
+    unsigned long long ble = %d * 1000ull * US, next_ble, end;
+    unsigned long wakeups = 0;
+    int polled = %d, phase;
+
+    /* the BLE events start at a different offset from the second in each run */
+    for (phase = 0; phase < PHASES; phase++) {
+        blt_timer.currentNum = 0;
+        app_wakeup_on = 0;
+        now = (17 * 1000000ull + phase * 7919) * US; /* not on a minute boundary */
+        next_ble = now + ble * phase / PHASES;
+        end = now + 3600ull * 1000000 * US;
+        blt_soft_timer_add(minute_tick, us_to_next_minute() + 1000);
+        blt_soft_timer_add(sensor_tick, 1000);
+        blt_soft_timer_add(led_tick, 1000);
+        while (now < end) {
+            unsigned long long next = next_ble;
+            if (!polled && app_wakeup_on) {
+                unsigned long long t = now + (u32)(app_wakeup - (u32)now);
+                if ((u32)(app_wakeup - (u32)now) < BIT(31) && t < next)
+                    next = t;
+            }
+            now = next;
+            if (now == next_ble)
+                next_ble += ble;
+            wakeups++;
+            blt_soft_timer_process(MAINLOOP_ENTRY);
+        }
+    }
+    printf("%%lu %%.1f %%.1f\n", wakeups / PHASES, minute_late / 1000.0, timer_late / 1000.0);
+    return 0;
+}
+'''
+
+
+def build(tmp, source, ble_ms, polled, name):
+    os.makedirs(os.path.join(tmp, 'stack', 'ble'), exist_ok=True)
+    with open(os.path.join(tmp, 'tl_common.h'), 'w') as f:
+        f.write(TL_COMMON)
+    with open(os.path.join(tmp, 'stack', 'ble', 'ble.h'), 'w') as f:
+        f.write('#pragma once\n#include "tl_common.h"\n')
+    harness = os.path.join(tmp, f'harness_{ble_ms}_{polled}.c')
+    with open(harness, 'w') as f:
+        f.write(HARNESS % (ble_ms, polled))
+    common = os.path.join(tmp, name, 'common')
+    os.makedirs(common, exist_ok=True)
+    with open(os.path.join(common, 'blt_soft_timer.c'), 'w', encoding='utf-8') as f:
+        f.write(source)
+    with open(os.path.join(common, 'blt_soft_timer.h'), 'w') as f:
+        f.write(open(os.path.join(ROOT, SOFT_TIMER[:-1] + 'h')).read())
+    exe = os.path.join(tmp, f'{name}_{ble_ms}_{polled}')
+    subprocess.run(['gcc', '-O2', '-I', tmp, '-I', os.path.join(tmp, name),
+                    '-I', os.path.join(ROOT, 'Firmware', 'components'),
+                    harness, os.path.join(common, 'blt_soft_timer.c'), '-o', exe], check=True)
+    return exe
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Modelled wakeups per hour of the app timers')
+    parser.add_argument('--against', help='git revision to compare the soft timer with')
+    parser.add_argument('--ble-ms', type=int, nargs='+', default=[1000, 2000],
+                        help='BLE event intervals, 1000 is the advertising interval')
+    args = parser.parse_args()
+
+    sources = [('tree', open(os.path.join(ROOT, SOFT_TIMER), encoding='utf-8').read())]
+    if args.against:
+        sources.insert(0, (args.against, subprocess.run(['git', 'show', f'{args.against}:{SOFT_TIMER}'], cwd=ROOT,
+                                                         check=True, capture_output=True, text=True).stdout))
+
+    print(f'{"":12} {"ble ms":>6} {"wakeups/h":>10} {"late ms: minute":>16} {"others":>7}')
+    with tempfile.TemporaryDirectory() as tmp:
+        for ble_ms in args.ble_ms:
+            runs = [('polled', sources[-1][1], 1)] + [(name, source, 0) for name, source in sources]
+            for i, (name, source, polled) in enumerate(runs):
+                out = subprocess.run([build(tmp, source, ble_ms, polled, f'src{i}')], check=True,
+                                     capture_output=True, text=True).stdout.split()
+                print(f'{name:12} {ble_ms:6} {int(out[0]):10} {float(out[1]):16.1f} {float(out[2]):7.1f}')
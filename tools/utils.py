@@ -1,3 +1,4 @@
+import io
 import os
 
 from PIL import Image
@@ -43,3 +44,138 @@ def load_test_image(name):
     path = os.path.join(os.path.dirname(__file__), 'data', 'images', name)
     print(f'open image: {path}')
     return Image.open(path)
+
+
+LZ_MIN_MATCH = 4
+LZ_MAX_MATCH = 0x7f + LZ_MIN_MATCH
+LZ_MAX_LITERAL = 0x80
+
+
+def lz_compress(data, window=4096, chain=32):
+    """Encode a bitplane for the 0x05 upload command, see Firmware/src/epd_lz.c"""
+    data = bytes(data)
+    out = bytearray()
+    literals = bytearray()
+    heads = {}
+
+    def flush():
+        while literals:
+            chunk = literals[:LZ_MAX_LITERAL]
+            out.append(len(chunk) - 1)
+            out.extend(chunk)
+            del literals[:LZ_MAX_LITERAL]
+
+    i = 0
+    while i < len(data):
+        best_len, best_dist = 0, 0
+        max_len = min(LZ_MAX_MATCH, len(data) - i)
+        for j in reversed(heads.get(data[i:i + LZ_MIN_MATCH], [])[-chain:]):
+            if i - j > window:
+                break
+            length = 0
+            while length < max_len and data[j + length] == data[i + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_dist = length, i - j
+                if length == max_len:
+                    break
+
+        if best_len >= LZ_MIN_MATCH:
+            flush()
+            out.append(0x80 | (best_len - LZ_MIN_MATCH))
+            out.extend(best_dist.to_bytes(2, 'big'))
+            step = best_len
+        else:
+            literals.append(data[i])
+            step = 1
+
+        for k in range(i, i + step):
+            if k + LZ_MIN_MATCH <= len(data):
+                heads.setdefault(data[k:k + LZ_MIN_MATCH], []).append(k)
+        i += step
+
+    flush()
+    return bytes(out)
+
+
+def lz_decompress(data, size):
+    """Reference decoder, mirrors epd_lz_feed()"""
+    out = bytearray()
+    i = 0
+    while i < len(data):
+        c = data[i]
+        i += 1
+        if c & 0x80:
+            length = (c & 0x7f) + LZ_MIN_MATCH
+            dist = data[i] << 8 | data[i + 1]
+            i += 2
+            for _ in range(length):
+                out.append(out[-dist])
+        else:
+            out.extend(data[i:i + c + 1])
+            i += c + 1
+    assert len(out) <= size
+    return bytes(out)
+
+
+def image2g4(image, width=250, height=122, dither=Dither.NONE):
+    """Raw CCITT G4 strip of an image, as streamed to EPD command 0x06"""
+    if isinstance(image, str):
+        image = Image.open(image)
+
+    image = image.resize((width, height)).convert('1', dither=dither)
+    out = io.BytesIO()
+    image.save(out, format='TIFF', compression='group4')
+    tiff = Image.open(io.BytesIO(out.getvalue()))
+    offset, size = tiff.tag_v2[273][0], tiff.tag_v2[279][0]
+    return out.getvalue()[offset:offset + size]
+
+
+DELTA_MAX_PACKET = 242  # command 0x0A: 2 header bytes + records
+
+
+def delta_encode(old, new, max_packet=DELTA_MAX_PACKET):
+    """XOR patch packets for the 0x0A upload command, see Firmware/src/epd_ble_service.c
+
+    Each record is a 16-bit skip, a count and count bytes XORed into the
+    plane. Gaps of up to 3 unchanged bytes are sent inside a record, as that
+    is cheaper than starting a new one.
+    """
+    changed = [i for i in range(len(new)) if old[i] != new[i]]
+    runs = []
+    for i in changed:
+        if runs and i - runs[-1][1] <= 3 and i - runs[-1][0] < 255:
+            runs[-1][1] = i
+        else:
+            runs.append([i, i])
+
+    packets, packet, pos = [], bytearray(), 0
+    for start, end in runs:
+        while start <= end:
+            count = min(end - start + 1, max_packet - len(packet) - 3)
+            if count <= 0:
+                packets.append(bytes(packet))
+                packet = bytearray()
+                continue
+            skip = start - pos  # planes are well below 64K
+            packet += bytes([skip >> 8, skip & 0xff, count])
+            packet += bytes(old[i] ^ new[i] for i in range(start, start + count))
+            pos = start = start + count
+    if packet:
+        packets.append(bytes(packet))
+    return packets
+
+
+def delta_apply(plane, packets):
+    """Reference for the device side of delta_encode()"""
+    plane, pos = bytearray(plane), 0
+    for packet in packets:
+        i = 0
+        while i + 3 <= len(packet):
+            pos += packet[i] << 8 | packet[i + 1]
+            count = packet[i + 2]
+            for x in packet[i + 3:i + 3 + count]:
+                plane[pos] ^= x
+                pos += 1
+            i += 3 + count
+    return bytes(plane)
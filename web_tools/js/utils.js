@@ -15,3 +15,88 @@ function bytesToHex(data) {
 function intToHex(intIn, bytes=4) {
     return intIn.toString(16).padStart(bytes * 2, '0');
 }
+
+// Encode a bitplane for the 0x05 upload command, see Firmware/src/epd_lz.c
+function lzCompress(data, windowSize = 4096, chain = 32) {
+  const MIN_MATCH = 4, MAX_MATCH = 0x7f + MIN_MATCH, MAX_LITERAL = 0x80;
+  const out = [];
+  const heads = new Map();
+  let literals = [];
+
+  const key = (i) => (data[i] << 24 | data[i + 1] << 16 | data[i + 2] << 8 | data[i + 3]) >>> 0;
+  const flush = () => {
+    while (literals.length) {
+      const chunk = literals.splice(0, MAX_LITERAL);
+      out.push(chunk.length - 1, ...chunk);
+    }
+  };
+
+  let i = 0;
+  while (i < data.length) {
+    let bestLen = 0, bestDist = 0;
+    const maxLen = Math.min(MAX_MATCH, data.length - i);
+    if (i + MIN_MATCH <= data.length) {
+      const candidates = heads.get(key(i)) || [];
+      for (let c = candidates.length - 1; c >= Math.max(0, candidates.length - chain); c--) {
+        const j = candidates[c];
+        if (i - j > windowSize) break;
+        let len = 0;
+        while (len < maxLen && data[j + len] === data[i + len]) len++;
+        if (len > bestLen) {
+          bestLen = len;
+          bestDist = i - j;
+          if (len === maxLen) break;
+        }
+      }
+    }
+
+    let step = 1;
+    if (bestLen >= MIN_MATCH) {
+      flush();
+      out.push(0x80 | (bestLen - MIN_MATCH), bestDist >> 8, bestDist & 0xff);
+      step = bestLen;
+    } else {
+      literals.push(data[i]);
+    }
+
+    for (let k = i; k < i + step; k++) {
+      if (k + MIN_MATCH > data.length) break;
+      const h = key(k);
+      if (!heads.has(h)) heads.set(h, []);
+      heads.get(h).push(k);
+    }
+    i += step;
+  }
+
+  flush();
+  return new Uint8Array(out);
+}
+
+// XOR patch packets for the 0x0A upload command, see deltaEncode in tools/utils.py
+function deltaEncode(oldPlane, newPlane, maxPacket = 242) {
+  const runs = [];
+  for (let i = 0; i < newPlane.length; i++) {
+    if (oldPlane[i] === newPlane[i]) continue;
+    const last = runs[runs.length - 1];
+    if (last && i - last[1] <= 3 && i - last[0] < 255) last[1] = i;
+    else runs.push([i, i]);
+  }
+  const packets = [];
+  let packet = [], pos = 0;
+  for (let [start, end] of runs) {
+    while (start <= end) {
+      const count = Math.min(end - start + 1, maxPacket - packet.length - 3);
+      if (count <= 0) {
+        packets.push(packet);
+        packet = [];
+        continue;
+      }
+      const skip = start - pos;
+      packet.push(skip >> 8, skip & 0xff, count);
+      for (let i = start; i < start + count; i++) packet.push(oldPlane[i] ^ newPlane[i]);
+      pos = start = start + count;
+    }
+  }
+  if (packet.length) packets.push(packet);
+  return packets;
+}